@@ -0,0 +1,1982 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <sstream>
+#include <thread>
+#include <tuple>
+#include <vector>
+#include "Benchmark.h"
+
+bool Benchmark::Run(std::string name, unsigned int dimension) {
+
+	if (name == "generate")
+		return OctreeGeneration(dimension);
+	if (name == "getvoxel")
+		return VoxelQueries(dimension);
+	if (name == "raycast")
+		return RayCasting(dimension);
+	if (name == "memory")
+		return MemoryUsage(dimension);
+	if (name == "edit")
+		return VoxelEdits(dimension);
+	if (name == "load")
+		return SaveAndLoad(dimension);
+	if (name == "stream")
+		return Streaming(dimension);
+	if (name == "dag")
+		return Deduplication(dimension);
+	if (name == "validate")
+		return Validation(dimension);
+	if (name == "decode")
+		return Decoding(dimension);
+	if (name == "layout")
+		return MapLayouts(dimension);
+	if (name == "chunks")
+		return ChunkedMap(dimension);
+	if (name == "terrain")
+		return TerrainGeneration(dimension);
+	if (name == "residency")
+		return ChunkResidency(dimension);
+	if (name == "lod")
+		return LevelOfDetail(dimension);
+	if (name == "region")
+		return RegionQueries(dimension);
+	if (name == "csg")
+		return BulkEdits(dimension);
+	if (name == "cursor")
+		return CursorSteps(dimension);
+	if (name == "distance")
+		return DistanceFields(dimension);
+	if (name == "mesh")
+		return MeshExtraction(dimension);
+	if (name == "components")
+		return ComponentLabelling(dimension);
+
+	std::cout << "Unknown benchmark " << name << std::endl;
+	return false;
+}
+
+bool Benchmark::OctreeGeneration(unsigned int dimension) {
+
+	SceneFixture fixture(dimension, "random");
+
+	std::cout << "Octree generation, " << dimension << "^3" << std::endl;
+	BenchmarkTable table({ { "threads", 10, 0 }, { "seconds", 14, 6 }, { "speedup", 12, 2 }, { "descriptors", 14, 0 },
+		{ "MiB", 12, 2 }, { "nodes", 10, 0 }, { "far", 8, 0 }, { "headers", 10, 0 }, { "depth", 8, 0 }, { "valid", 8, 0 } });
+
+	bool all_valid = true;
+	double single_thread_time = 0;
+
+	for (unsigned int threads : { 1, 2, 4, 8, 16 }) {
+
+		// Take the best of a few runs to keep the noise down on small maps
+		double best = 0;
+		for (int run = 0; run < 3; run++) {
+			double start = Now();
+			fixture.octree.Generate(&fixture.array_map, threads);
+			double elapsed = Seconds(start);
+			if (run == 0 || elapsed < best)
+				best = elapsed;
+		}
+
+		if (threads == 1)
+			single_thread_time = best;
+
+		const OctreeBuildStats &stats = fixture.octree.build_stats;
+
+		bool valid = fixture.validate();
+		all_valid &= valid;
+
+		table.row(threads, best, single_thread_time / best, fixture.octree.descriptor_buffer.size(),
+			fixture.octree.descriptor_buffer.memory_usage() / (1024.0 * 1024.0), stats.nodes, stats.far_pointers,
+			stats.page_headers, stats.max_depth, valid);
+	}
+
+	return all_valid;
+}
+
+bool Benchmark::VoxelQueries(unsigned int dimension) {
+
+	std::cout << "Voxel queries, GetVoxel loop vs GetVoxels batch" << std::endl;
+	BenchmarkTable table({ { "map", 8, 0 }, { "queries", 10, 0 }, { "order", 10, 0 },
+		{ "loop q/s", 16, 0 }, { "batch q/s", 16, 0 }, { "speedup", 10, 2 } });
+
+	bool all_match = true;
+
+	for (unsigned int map_dimension = 32; map_dimension <= dimension; map_dimension *= 2) {
+
+		SceneFixture fixture(map_dimension, "random");
+		Octree &octree = fixture.octree;
+
+		size_t query_count = std::min((size_t)map_dimension * map_dimension * map_dimension, (size_t)1 << 22);
+		std::vector<Vector3i> positions(query_count);
+		std::vector<char> loop_results(query_count);
+		std::vector<char> batch_results(query_count);
+
+		for (std::string order : { "random", "linear" }) {
+
+			std::mt19937 rng(1234);
+			std::uniform_int_distribution<int> coordinate(0, map_dimension - 1);
+
+			for (size_t i = 0; i < query_count; i++) {
+				if (order == "random")
+					positions[i] = Vector3i(coordinate(rng), coordinate(rng), coordinate(rng));
+				else
+					positions[i] = Vector3i(i % map_dimension, i / map_dimension % map_dimension, i / (map_dimension * map_dimension));
+			}
+
+			double start = Now();
+			for (size_t i = 0; i < query_count; i++)
+				loop_results[i] = octree.GetVoxel(positions[i]).value;
+			double loop_time = Seconds(start);
+
+			start = Now();
+			octree.GetVoxels(positions.data(), query_count, batch_results.data());
+			double batch_time = Seconds(start);
+
+			all_match &= loop_results == batch_results;
+
+			table.row(map_dimension, query_count, order, query_count / loop_time, query_count / batch_time, loop_time / batch_time);
+		}
+	}
+
+	if (!all_match)
+		std::cout << "Batched results did not match GetVoxel" << std::endl;
+
+	return all_match;
+}
+
+bool Benchmark::RayCasting(unsigned int dimension) {
+
+	SceneFixture fixture(dimension, "terrain");
+	ArrayMap &array_map = fixture.array_map;
+	Octree &octree = fixture.octree;
+
+	// Rays start anywhere in the upper half of the map and head off in any direction
+	const size_t ray_count = 1 << 20;
+	std::vector<Vector3f> origins(ray_count);
+	std::vector<Vector3f> directions(ray_count);
+
+	std::mt19937 rng(1234);
+	std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+	std::uniform_real_distribution<float> coordinate(0.0f, (float)dimension);
+	std::uniform_real_distribution<float> height(dimension / 2.0f, (float)dimension);
+
+	for (size_t i = 0; i < ray_count; i++) {
+		origins[i] = Vector3f(coordinate(rng), height(rng), coordinate(rng));
+		directions[i] = Vector3f(unit(rng), unit(rng), unit(rng));
+	}
+
+	float max_distance = dimension * 2.0f;
+	std::vector<RayHit> octree_hits(ray_count);
+	std::vector<RayHit> dda_hits(ray_count);
+
+	double start = Now();
+	for (size_t i = 0; i < ray_count; i++)
+		octree_hits[i] = octree.CastRay(origins[i], directions[i], max_distance);
+	double octree_time = Seconds(start);
+
+	start = Now();
+	for (size_t i = 0; i < ray_count; i++)
+		dda_hits[i] = DDACastRay(&array_map, origins[i], directions[i], max_distance);
+	double dda_time = Seconds(start);
+
+	size_t hits = 0;
+	size_t mismatches = 0;
+	for (size_t i = 0; i < ray_count; i++) {
+		hits += octree_hits[i].hit;
+		if (octree_hits[i].hit != dda_hits[i].hit ||
+			(octree_hits[i].hit && (octree_hits[i].voxel != dda_hits[i].voxel || octree_hits[i].value != dda_hits[i].value)))
+			mismatches++;
+	}
+
+	std::cout << "Ray casting, " << dimension << "^3 terrain, " << ray_count << " rays, " << hits << " hits" << std::endl;
+	std::cout << std::setw(12) << "CastRay" << std::setw(16) << std::fixed << std::setprecision(0) << ray_count / octree_time << " rays/s" << std::endl;
+	std::cout << std::setw(12) << "DDA" << std::setw(16) << ray_count / dda_time << " rays/s" << std::endl;
+	std::cout << std::setw(12) << "speedup" << std::setw(16) << std::setprecision(2) << dda_time / octree_time << std::endl;
+	std::cout << std::setw(12) << "mismatches" << std::setw(16) << mismatches << std::endl;
+
+	// Rays that graze an edge or corner exactly can legitimately pick different neighbours
+	return mismatches <= ray_count / 10000;
+}
+
+bool Benchmark::MemoryUsage(unsigned int dimension) {
+
+	std::cout << "Memory, dense array vs octree with attachments" << std::endl;
+	BenchmarkTable table({ { "map", 8, 0 }, { "scene", 10, 0 }, { "dense MiB", 14, 2 }, { "octree MiB", 14, 2 },
+		{ "descriptors", 14, 0 }, { "attachments", 14, 0 }, { "ratio", 8, 2 }, { "valid", 8, 0 } });
+
+	bool all_valid = true;
+
+	for (unsigned int map_dimension = 32; map_dimension <= dimension; map_dimension *= 2) {
+		for (std::string scene : { "random", "terrain" }) {
+
+			SceneFixture fixture(map_dimension, scene);
+
+			bool valid = fixture.validate();
+			all_valid &= valid;
+
+			double dense = (double)map_dimension * map_dimension * map_dimension;
+			double tree = (double)fixture.octree.MemoryUsage();
+
+			table.row(map_dimension, scene, dense / (1024.0 * 1024.0), tree / (1024.0 * 1024.0),
+				fixture.octree.descriptor_buffer.size(), fixture.octree.attachment_buffer.size(), dense / tree, valid);
+		}
+	}
+
+	return all_valid;
+}
+
+bool Benchmark::VoxelEdits(unsigned int dimension) {
+
+	SceneFixture fixture(dimension, "terrain");
+	ArrayMap &array_map = fixture.array_map;
+	Octree &octree = fixture.octree;
+
+	const size_t edit_count = 1 << 20;
+	std::vector<Vector3i> positions(edit_count);
+	std::vector<char> values(edit_count);
+
+	std::mt19937 rng(1234);
+	std::uniform_int_distribution<int> coordinate(0, dimension - 1);
+	std::uniform_int_distribution<int> material(0, 3);
+
+	for (size_t i = 0; i < edit_count; i++) {
+		positions[i] = Vector3i(coordinate(rng), coordinate(rng), coordinate(rng));
+		values[i] = (char)material(rng);
+	}
+
+	std::vector<Vector3i> queries(edit_count);
+	for (size_t i = 0; i < edit_count; i++)
+		queries[i] = Vector3i(coordinate(rng), coordinate(rng), coordinate(rng));
+
+	std::cout << "Voxel edits, " << dimension << "^3 terrain, " << edit_count << " random edits" << std::endl;
+	BenchmarkTable table({ { "tree", 12, 0 }, { "seconds", 14, 6 }, { "descriptors", 14, 0 }, { "MiB", 12, 2 },
+		{ "attachments", 14, 0 }, { "GetVoxel q/s", 16, 0 }, { "valid", 8, 0 } });
+
+	bool all_valid = true;
+
+	auto report = [&](std::string name, double seconds) {
+
+		double start = Now();
+		for (size_t i = 0; i < edit_count; i++)
+			octree.GetVoxel(queries[i]);
+		double query_time = Seconds(start);
+
+		bool valid = fixture.validate();
+		all_valid &= valid;
+
+		table.row(name, seconds, octree.descriptor_buffer.size(), octree.MemoryUsage() / (1024.0 * 1024.0),
+			octree.attachment_buffer.size() + octree.edit_attachment_buffer.size(), edit_count / query_time, valid);
+	};
+
+	report("generated", 0);
+
+	double start = Now();
+	for (size_t i = 0; i < edit_count; i++)
+		octree.SetVoxel(positions[i], values[i]);
+	double edit_time = Seconds(start);
+
+	for (size_t i = 0; i < edit_count; i++)
+		array_map.setVoxel(positions[i], values[i]);
+
+	report("edited", edit_time);
+
+	start = Now();
+	octree.Compact();
+	report("compacted", Seconds(start));
+
+	// What a full rebuild of the edited map would cost and look like
+	start = Now();
+	octree.Generate(&array_map);
+	report("regenerated", Seconds(start));
+
+	std::cout << std::setw(12) << "edits/s" << std::setw(14) << std::setprecision(0) << edit_count / edit_time << std::endl;
+
+	return all_valid;
+}
+
+bool Benchmark::SaveAndLoad(unsigned int dimension) {
+
+	std::string file_name = "octree_benchmark.oct";
+
+	std::cout << "Save and load, " << dimension << "^3" << std::endl;
+	BenchmarkTable table({ { "scene", 10, 0 }, { "generate s", 14, 6 }, { "save s", 14, 6 }, { "load s", 14, 6 },
+		{ "file MiB", 12, 2 }, { "first query s", 14, 6 }, { "valid", 8, 0 } });
+
+	bool all_valid = true;
+
+	for (std::string scene : { "random", "terrain" }) {
+
+		SceneFixture fixture(dimension, scene);
+
+		double start = Now();
+		bool saved = fixture.octree.Save(file_name);
+		double save_time = Seconds(start);
+
+		std::ifstream file(file_name, std::ios::binary | std::ios::ate);
+		double file_size = (double)file.tellg();
+		file.close();
+
+		Octree loaded;
+
+		start = Now();
+		bool valid = saved && loaded.Load(file_name);
+		double load_time = Seconds(start);
+
+		// Pages are only read in from the file as they're touched
+		start = Now();
+		loaded.GetVoxel(Vector3i(dimension / 2, dimension / 2, dimension / 2));
+		double query_time = Seconds(start);
+
+		valid = valid && loaded.Validate(&fixture.array_map).valid();
+		all_valid &= valid;
+
+		table.row(scene, fixture.generate_time, save_time, load_time, file_size / (1024.0 * 1024.0), query_time, valid);
+	}
+
+	std::remove(file_name.c_str());
+
+	return all_valid;
+}
+
+bool Benchmark::Streaming(unsigned int dimension) {
+
+	std::string file_name = "octree_benchmark.oct";
+
+	SceneFixture fixture(dimension, "random");
+	Octree &octree = fixture.octree;
+	octree.Save(file_name);
+
+	uint64_t page_count = (octree.descriptor_buffer.size() + Octree::page_size - 1) / Octree::page_size;
+
+	const size_t query_count = 1 << 20;
+	std::vector<Vector3i> positions(query_count);
+
+	std::mt19937 rng(1234);
+	std::uniform_int_distribution<int> coordinate(0, dimension - 1);
+	for (size_t i = 0; i < query_count; i++)
+		positions[i] = Vector3i(coordinate(rng), coordinate(rng), coordinate(rng));
+
+	std::vector<char> expected(query_count);
+	octree.GetVoxels(positions.data(), query_count, expected.data());
+
+	std::cout << "Streaming, " << dimension << "^3 random, " << page_count << " descriptor pages, " << query_count << " queries" << std::endl;
+	BenchmarkTable table({ { "cache", 8, 0 }, { "cache MiB", 12, 2 }, { "order", 10, 0 }, { "q/s", 14, 0 },
+		{ "hits", 12, 0 }, { "misses", 12, 0 }, { "evictions", 12, 0 }, { "valid", 8, 0 } });
+
+	bool all_valid = true;
+
+	for (uint64_t cache_pages : { page_count / 8, page_count / 4, page_count / 2, page_count }) {
+
+		if (cache_pages == 0)
+			continue;
+
+		Octree streamed;
+		if (!streamed.Stream(file_name, cache_pages))
+			return false;
+
+		for (std::string order : { "random", "batched", "threads" }) {
+
+			streamed.page_cache->reset_stats();
+			std::vector<char> results(query_count);
+
+			double start = Now();
+			if (order == "random") {
+				for (size_t i = 0; i < query_count; i++)
+					results[i] = streamed.GetVoxel(positions[i]).value;
+			}
+			else if (order == "batched") {
+				streamed.GetVoxels(positions.data(), query_count, results.data());
+			}
+			else {
+
+				// The random queries split over every hardware thread, all going through the cache
+				unsigned int thread_count = std::max(1u, std::thread::hardware_concurrency());
+				std::vector<std::thread> workers;
+				for (unsigned int t = 0; t < thread_count; t++) {
+					workers.emplace_back([&, t]() {
+						for (size_t i = query_count * t / thread_count; i < query_count * (t + 1) / thread_count; i++)
+							results[i] = streamed.GetVoxel(positions[i]).value;
+					});
+				}
+				for (std::thread &worker : workers)
+					worker.join();
+			}
+			double query_time = Seconds(start);
+
+			PageCacheStats stats = streamed.page_cache->stats();
+
+			bool valid = results == expected;
+			all_valid &= valid;
+
+			table.row(cache_pages, streamed.page_cache->memory_usage() / (1024.0 * 1024.0), order, query_count / query_time,
+				stats.hits, stats.misses, stats.evictions, valid);
+		}
+	}
+
+	std::remove(file_name.c_str());
+
+	return all_valid;
+}
+
+bool Benchmark::Deduplication(unsigned int dimension) {
+
+	std::cout << "Subtree deduplication, tree vs DAG" << std::endl;
+	BenchmarkTable table({ { "map", 8, 0 }, { "scene", 10, 0 }, { "tree desc", 14, 0 }, { "tree MiB", 12, 2 },
+		{ "DAG desc", 14, 0 }, { "DAG MiB", 12, 2 }, { "shared", 10, 0 }, { "ratio", 10, 2 }, { "seconds", 12, 6 }, { "valid", 8, 0 } });
+
+	bool all_valid = true;
+
+	for (unsigned int map_dimension = 32; map_dimension <= dimension; map_dimension *= 2) {
+		for (std::string scene : { "random", "terrain" }) {
+
+			SceneFixture fixture(map_dimension, scene);
+			Octree &octree = fixture.octree;
+
+			uint64_t tree_descriptors = octree.descriptor_buffer.size();
+			double tree_bytes = (double)octree.MemoryUsage();
+
+			double start = Now();
+			octree.Deduplicate();
+			double dedup_time = Seconds(start);
+
+			double dag_bytes = (double)octree.MemoryUsage();
+
+			bool valid = fixture.validate();
+			all_valid &= valid;
+
+			table.row(map_dimension, scene, tree_descriptors, tree_bytes / (1024.0 * 1024.0), octree.descriptor_buffer.size(),
+				dag_bytes / (1024.0 * 1024.0), octree.build_stats.shared_blocks, tree_bytes / dag_bytes, dedup_time, valid);
+		}
+	}
+
+	return all_valid;
+}
+
+bool Benchmark::Validation(unsigned int dimension) {
+
+	SceneFixture fixture(dimension, "random");
+	ArrayMap &array_map = fixture.array_map;
+	Octree &octree = fixture.octree;
+
+	std::cout << "Validation, " << dimension << "^3 random" << std::endl;
+	BenchmarkTable table({ { "method", 16, 0 }, { "threads", 10, 0 }, { "seconds", 14, 6 }, { "voxels/s", 16, 0 }, { "mismatches", 12, 0 } });
+
+	// What Validate used to do, a GetVoxel from the root for every voxel
+	double start = Now();
+	uint64_t per_voxel_mismatches = 0;
+	for (int z = 0; z < (int)dimension; z++)
+		for (int y = 0; y < (int)dimension; y++)
+			for (int x = 0; x < (int)dimension; x++)
+				per_voxel_mismatches += octree.GetVoxel(Vector3i(x, y, z)).value != array_map.getVoxel(Vector3i(x, y, z));
+	double per_voxel_time = Seconds(start);
+
+	double voxels = (double)dimension * dimension * dimension;
+
+	table.row("GetVoxel loop", 1, per_voxel_time, voxels / per_voxel_time, per_voxel_mismatches);
+
+	bool all_valid = per_voxel_mismatches == 0;
+
+	for (unsigned int threads : { 1, 2, 4, 8 }) {
+
+		start = Now();
+		ValidationReport report = octree.Validate(&array_map, threads);
+		double validate_time = Seconds(start);
+
+		all_valid &= report.valid() && report.voxels == voxels;
+
+		table.row("Validate", threads, validate_time, voxels / validate_time, report.mismatch_count);
+	}
+
+	// Knock out a few voxels and make sure every one of them is caught
+	const int broken = 100;
+	std::mt19937 rng(1234);
+	std::uniform_int_distribution<int> coordinate(0, dimension - 1);
+
+	for (int i = 0; i < broken; i++) {
+		Vector3i position(coordinate(rng), coordinate(rng), coordinate(rng));
+		array_map.setVoxel(position, array_map.getVoxel(position) == 5 ? 6 : 5);
+	}
+
+	ValidationReport report = octree.Validate(&array_map);
+	std::cout << std::setw(16) << "broken voxels" << std::setw(10) << broken << std::setw(14) << report.mismatch_count << " found, first at "
+		<< report.mismatches[0].position.x << " " << report.mismatches[0].position.y << " " << report.mismatches[0].position.z << std::endl;
+
+	// Collisions in the random positions are possible but unlikely
+	all_valid &= report.mismatch_count > broken - 5 && report.mismatch_count <= broken;
+
+	return all_valid;
+}
+
+bool Benchmark::Decoding(unsigned int dimension) {
+
+	uint64_t voxels = (uint64_t)dimension * dimension * dimension;
+	std::vector<char> decoded(voxels);
+
+	std::cout << "Decoding, " << dimension << "^3" << std::endl;
+	BenchmarkTable table({ { "scene", 10, 0 }, { "region", 10, 0 }, { "threads", 10, 0 }, { "seconds", 14, 6 }, { "GiB/s", 12, 3 }, { "match", 8, 0 } });
+
+	bool all_match = true;
+
+	for (std::string scene : { "random", "terrain" }) {
+
+		SceneFixture fixture(dimension, scene);
+		ArrayMap &array_map = fixture.array_map;
+		Octree &octree = fixture.octree;
+
+		// What a decode looked like before, a GetVoxel for every voxel
+		double start = Now();
+		for (int z = 0; z < (int)dimension; z++)
+			for (int y = 0; y < (int)dimension; y++)
+				for (int x = 0; x < (int)dimension; x++)
+					decoded[x + dimension * (y + dimension * z)] = octree.GetVoxel(Vector3i(x, y, z)).value;
+		double loop_time = Seconds(start);
+
+		all_match &= std::equal(decoded.begin(), decoded.end(), array_map.getDataPtr());
+
+		table.row(scene, "GetVoxel", 1, loop_time, voxels / loop_time / (1024.0 * 1024.0 * 1024.0));
+
+		for (unsigned int threads : { 1, 2, 4, 8 }) {
+
+			std::fill(decoded.begin(), decoded.end(), (char)-1);
+
+			start = Now();
+			octree.Decode(decoded.data(), threads);
+			double decode_time = Seconds(start);
+
+			bool match = std::equal(decoded.begin(), decoded.end(), array_map.getDataPtr());
+			all_match &= match;
+
+			table.row(scene, "whole", threads, decode_time, voxels / decode_time / (1024.0 * 1024.0 * 1024.0), match);
+		}
+
+		// An off center region that doesn't line up with the nodes
+		IntCube region(dimension / 5, dimension / 3, dimension / 7, dimension / 2 + 3, dimension / 3 + 1, dimension / 2 - 5);
+		uint64_t region_voxels = (uint64_t)region.width * region.height * region.depth;
+
+		start = Now();
+		octree.Decode(region, decoded.data());
+		double region_time = Seconds(start);
+
+		bool match = true;
+		for (int z = 0; z < region.depth; z++)
+			for (int y = 0; y < region.height; y++)
+				for (int x = 0; x < region.width; x++)
+					match &= decoded[x + region.width * (y + region.height * z)] == array_map.getVoxel(Vector3i(x + region.left, y + region.top, z + region.front));
+		all_match &= match;
+
+		table.row(scene, "region", std::thread::hardware_concurrency(), region_time,
+			region_voxels / region_time / (1024.0 * 1024.0 * 1024.0), match);
+	}
+
+	return all_match;
+}
+
+bool Benchmark::MapLayouts(unsigned int dimension) {
+
+	Vector3i dim3(dimension, dimension, dimension);
+
+	const VoxelLayout layouts[4] = { VoxelLayout::Linear, VoxelLayout::Morton, VoxelLayout::Bricked, VoxelLayout::Occupancy };
+	const char* layout_names[4] = { "linear", "morton", "bricked", "occupancy" };
+
+	// The same positions for every layout
+	const size_t query_count = 1 << 22;
+	std::vector<Vector3i> positions(query_count);
+	std::mt19937 rng(1234);
+	std::uniform_int_distribution<int> coordinate(0, dimension - 2);
+	for (Vector3i &position : positions)
+		position = Vector3i(coordinate(rng), coordinate(rng), coordinate(rng));
+
+	std::cout << "ArrayMap layouts, " << dimension << "^3" << std::endl;
+	BenchmarkTable table({ { "scene", 10, 0 }, { "layout", 10, 0 }, { "MiB", 10, 1 }, { "generate s", 14, 4 },
+		{ "validate s", 14, 4 }, { "random q/s", 14, 0 }, { "2^3 q/s", 14, 0 }, { "valid", 8, 0 } });
+
+	bool all_valid = true;
+
+	for (std::string scene : { "random", "terrain" }) {
+		for (int l = 0; l < 4; l++) {
+
+			SceneFixture fixture(dimension, scene, layouts[l]);
+			ArrayMap &array_map = fixture.array_map;
+
+			double start = Now();
+			bool valid = fixture.validate();
+			double validate_time = Seconds(start);
+			all_valid &= valid;
+
+			// Single voxels at random, and the 2^3 block at each position like the octree reads
+			uint64_t sum = 0;
+			start = Now();
+			for (const Vector3i &position : positions)
+				sum += array_map.getVoxel(position);
+			double random_time = Seconds(start);
+
+			start = Now();
+			for (const Vector3i &position : positions)
+				for (int i = 0; i < 8; i++)
+					sum += array_map.getVoxel(Vector3i(position.x + (i & 1), position.y + ((i >> 1) & 1), position.z + (i >> 2)));
+			double block_time = Seconds(start);
+
+			// Keeps the reads from being optimized out
+			if (sum == 1)
+				std::cout << "";
+
+			table.row(scene, layout_names[l], ArrayMap::getSize(layouts[l], dim3) / (1024.0 * 1024.0), fixture.generate_time,
+				validate_time, query_count / random_time, query_count / block_time, valid);
+		}
+	}
+
+	return all_valid;
+}
+
+bool Benchmark::ChunkedMap(unsigned int dimension) {
+
+	Map map(0, dimension);
+
+	// Balls scattered over a couple million voxels on each axis, far too big to ever be dense
+	const int ball_count = 64;
+	const int radius = 12;
+	const int extent = 1 << 20;
+
+	std::mt19937 rng(1234);
+	std::uniform_int_distribution<int> coordinate(-extent, extent);
+
+	std::vector<Vector3i> positions;
+	for (int b = 0; b < ball_count; b++) {
+		Vector3i center(coordinate(rng), coordinate(rng), coordinate(rng));
+		for (int z = -radius; z <= radius; z++)
+			for (int y = -radius; y <= radius; y++)
+				for (int x = -radius; x <= radius; x++)
+					if (x * x + y * y + z * z <= radius * radius)
+						positions.push_back(center + Vector3i(x, y, z));
+	}
+
+	std::cout << "Chunked map, " << dimension << "^3 chunks, " << ball_count << " balls over " << 2 * extent << "^3" << std::endl;
+
+	double start = Now();
+	for (size_t i = 0; i < positions.size(); i++)
+		map.setVoxel(positions[i], 1 + i % 3);
+	double set_time = Seconds(start);
+
+	size_t chunk_count = map.getChunkCount();
+	uint64_t bytes = map.getMemoryUsage();
+
+	map.compact();
+	uint64_t compacted_bytes = map.getMemoryUsage();
+
+	// Every ball voxel, then as many positions out in empty space
+	bool valid = true;
+	start = Now();
+	for (size_t i = 0; i < positions.size(); i++)
+		valid &= map.getVoxel(positions[i]) == 1 + (char)(i % 3);
+	double get_time = Seconds(start);
+
+	size_t empty_hits = 0;
+	start = Now();
+	for (size_t i = 0; i < positions.size(); i++)
+		empty_hits += map.getVoxel(Vector3i(coordinate(rng), coordinate(rng), coordinate(rng))) != 0;
+	double empty_time = Seconds(start);
+
+	// Clearing everything should leave no chunks behind
+	for (const Vector3i &position : positions)
+		map.setVoxel(position, 0);
+	valid &= map.getChunkCount() == 0;
+
+	BenchmarkTable table({ { "voxels", 12, 0 }, { "chunks", 10, 0 }, { "MiB", 10, 2 }, { "compact MiB", 14, 2 },
+		{ "set/s", 14, 0 }, { "get/s", 14, 0 }, { "empty get/s", 14, 0 }, { "valid", 8, 0 } });
+	table.row(positions.size(), chunk_count, bytes / (1024.0 * 1024.0), compacted_bytes / (1024.0 * 1024.0),
+		positions.size() / set_time, positions.size() / get_time, positions.size() / empty_time, valid);
+
+	return valid && empty_hits == 0;
+}
+
+bool Benchmark::TerrainGeneration(unsigned int dimension) {
+
+	std::cout << "Terrain generation, " << dimension << "^3 in 32^3 chunks" << std::endl;
+	BenchmarkTable table({ { "caves", 10, 0 }, { "seed", 8, 0 }, { "threads", 10, 0 }, { "seconds", 14, 4 },
+		{ "voxels/s", 14, 0 }, { "chunks", 10, 0 }, { "solid", 10, 3 }, { "hash", 20, 0 }, { "same", 8, 0 } });
+
+	bool all_same = true;
+
+	for (bool caves : { false, true }) {
+
+		uint64_t first_hash = 0;
+
+		for (uint64_t seed : { 1, 2 }) {
+			for (unsigned int threads : { 1, 2, 4, 8 }) {
+
+				Map map(0, 32);
+
+				double start = Now();
+				map.generateTerrain(dimension, seed, caves, threads);
+				double seconds = Seconds(start);
+
+				// FNV-1a over every voxel of the cube chunk by chunk, to check the thread count
+				// makes no difference
+				uint64_t hash = 0xCBF29CE484222325;
+				uint64_t solid = 0;
+				std::vector<char> voxels(32 * 32 * 32);
+
+				for (int z = 0; z < (int)dimension / 32; z++) {
+					for (int y = 0; y < (int)dimension / 32; y++) {
+						for (int x = 0; x < (int)dimension / 32; x++) {
+
+							MapChunk* chunk = map.getChunk(Vector3i(x, y, z));
+							std::fill(voxels.begin(), voxels.end(), 0);
+							if (chunk)
+								chunk->octree.Decode(voxels.data(), 1);
+
+							for (char voxel : voxels) {
+								hash = (hash ^ (uint8_t)voxel) * 0x100000001B3;
+								solid += voxel != 0;
+							}
+						}
+					}
+				}
+
+				if (threads == 1)
+					first_hash = hash;
+				bool same = hash == first_hash;
+				all_same &= same;
+
+				std::ostringstream hex;
+				hex << std::hex << hash;
+
+				table.row(caves, seed, threads, seconds, std::pow((double)dimension, 3) / seconds, map.getChunkCount(),
+					solid / std::pow((double)dimension, 3), hex.str(), same);
+			}
+		}
+	}
+
+	return all_same;
+}
+
+bool Benchmark::ChunkResidency(unsigned int dimension) {
+
+	Map map(0, 32);
+	map.setTerrain(dimension, 1);
+
+	const uint64_t budget = 1024 * 1024;
+	const int radius = 4;
+	const int frames = 96;
+	const int speed = 16;
+
+	ChunkManager manager(&map, "residency_benchmark_", budget, radius);
+
+	std::cout << "Chunk residency, terrain " << dimension << " high, " << budget / (1024 * 1024) << " MiB budget, radius " << radius
+		<< ", " << speed << " voxels a frame out and back" << std::endl;
+	BenchmarkTable table({ { "frame", 8, 0 }, { "focus x", 10, 0 }, { "resident", 10, 0 }, { "MiB", 10, 2 }, { "queued", 10, 0 },
+		{ "flight", 10, 0 }, { "generated", 11, 0 }, { "loaded", 10, 0 }, { "evicted", 10, 0 }, { "update ms", 12, 3 } });
+
+	double slowest_update = 0;
+
+	// Walks out along x and back again, so the way back comes off the disk
+	for (int frame = 0; frame <= 2 * frames; frame++) {
+
+		int x = speed * (frame <= frames ? frame : 2 * frames - frame);
+		manager.setFocus({ Vector3i(x, dimension / 2, 0) });
+
+		double start = Now();
+		manager.update();
+		double update_time = Seconds(start);
+		slowest_update = std::max(slowest_update, update_time);
+
+		// Something like a frame's worth of time for the workers
+		std::this_thread::sleep_for(std::chrono::milliseconds(5));
+
+		if (frame % 16 == 0) {
+			ChunkManagerStats stats = manager.getStats();
+			table.row(frame, x, stats.resident_chunks, stats.resident_bytes / (1024.0 * 1024.0), stats.queued, stats.in_flight,
+				stats.generated, stats.loaded, stats.evicted, update_time * 1000);
+		}
+	}
+
+	manager.flush();
+	ChunkManagerStats stats = manager.getStats();
+
+	// The chunks around the start came back off the disk and should match the terrain
+	bool valid = true;
+	std::vector<char> resident(32 * 32 * 32);
+	std::vector<char> generated(32 * 32 * 32);
+
+	for (auto &chunk : map.chunks) {
+
+		std::unique_ptr<MapChunk> fresh = map.generateChunk(chunk.first);
+		std::fill(generated.begin(), generated.end(), 0);
+		if (fresh)
+			fresh->octree.Decode(generated.data(), 1);
+
+		chunk.second->octree.Decode(resident.data(), 1);
+		valid &= resident == generated && (!fresh || fresh->voxel_count == chunk.second->voxel_count);
+	}
+
+	std::cout << "slowest update " << std::setprecision(3) << slowest_update * 1000 << " ms, " << stats.loaded << " chunks read back, "
+		<< stats.empty << " empty, " << stats.evicted_bytes / (1024.0 * 1024.0) << " MiB evicted, resident chunks "
+		<< (valid ? "match" : "don't match") << " the terrain" << std::endl;
+
+	manager.clearDisk();
+
+	return valid && stats.loaded > 0;
+}
+
+bool Benchmark::LevelOfDetail(unsigned int dimension) {
+
+	SceneFixture fixture(dimension, "terrain");
+	ArrayMap &array_map = fixture.array_map;
+	Octree &octree = fixture.octree;
+
+	unsigned int levels = 0;
+	while ((1u << levels) < dimension)
+		levels++;
+
+	std::mt19937 rng(1234);
+	std::uniform_int_distribution<int> coordinate(0, dimension - 1);
+
+	const size_t query_count = 1 << 18;
+	std::vector<Vector3i> queries(query_count);
+	for (size_t i = 0; i < query_count; i++)
+		queries[i] = Vector3i(coordinate(rng), coordinate(rng), coordinate(rng));
+
+	// How many voxels are set in every node at every depth, counted up from the map
+	std::vector<std::vector<uint32_t>> counts(levels + 1);
+	auto count_voxels = [&]() {
+
+		counts[levels].assign((size_t)dimension * dimension * dimension, 0);
+		for (unsigned int z = 0; z < dimension; z++)
+			for (unsigned int y = 0; y < dimension; y++)
+				for (unsigned int x = 0; x < dimension; x++)
+					counts[levels][x + dimension * (y + dimension * z)] = array_map.getVoxel(Vector3i(x, y, z)) != 0;
+
+		for (int depth = levels - 1; depth >= 0; depth--) {
+
+			size_t side = (size_t)1 << depth;
+			counts[depth].assign(side * side * side, 0);
+
+			for (size_t z = 0; z < side * 2; z++)
+				for (size_t y = 0; y < side * 2; y++)
+					for (size_t x = 0; x < side * 2; x++)
+						counts[depth][x / 2 + side * (y / 2 + side * (z / 2))] += counts[depth + 1][x + side * 2 * (y + side * 2 * z)];
+		}
+	};
+
+	std::cout << "Level of detail, " << dimension << "^3 terrain, " << query_count << " GetVoxel queries a depth" << std::endl;
+	BenchmarkTable table({ { "tree", 12, 0 }, { "depth", 8, 0 }, { "node", 8, 0 }, { "GetVoxel q/s", 16, 0 }, { "max error", 14, 4 }, { "valid", 8, 0 } });
+
+	bool all_valid = true;
+
+	// Coverage is kept in 255ths and rounded at every level, so it can drift a little from the
+	// real fraction, but empty and solid nodes have to come out exact
+	auto report = [&](std::string name) {
+
+		count_voxels();
+
+		// However the tree got here it has to agree exactly with one generated from the map
+		Octree reference;
+		reference.Generate(&array_map);
+
+		for (unsigned int depth = 0; depth <= levels; depth++) {
+
+			std::vector<OctState> states(query_count);
+
+			double start = Now();
+			for (size_t i = 0; i < query_count; i++)
+				states[i] = octree.GetVoxel(queries[i], depth);
+			double query_time = Seconds(start);
+
+			unsigned int size = dimension >> depth;
+			size_t side = (size_t)1 << depth;
+			double max_error = 0;
+			bool valid = true;
+
+			for (size_t i = 0; i < query_count; i++) {
+
+				Vector3i node(queries[i].x / size, queries[i].y / size, queries[i].z / size);
+				uint32_t count = counts[depth][node.x + side * (node.y + side * node.z)];
+				double expected = count / ((double)size * size * size);
+
+				max_error = std::max(max_error, std::fabs(states[i].coverage - expected));
+				if ((count == 0) != (states[i].coverage == 0) || (expected == 1) != (states[i].coverage == 1))
+					valid = false;
+				if (depth == levels && states[i].value != array_map.getVoxel(queries[i]))
+					valid = false;
+
+				OctState expected_state = reference.GetVoxel(queries[i], depth);
+				if (states[i].value != expected_state.value || states[i].coverage != expected_state.coverage)
+					valid = false;
+			}
+
+			valid &= max_error < 0.02;
+			all_valid &= valid;
+
+			table.row(depth == 0 ? name : "", depth, size, query_count / query_time, max_error, valid);
+		}
+	};
+
+	report("generated");
+
+	// Edits have to keep the coverage of every node above them right
+	std::uniform_int_distribution<int> material(0, 3);
+	for (size_t i = 0; i < (1 << 16); i++) {
+		Vector3i position(coordinate(rng), coordinate(rng), coordinate(rng));
+		char value = (char)material(rng);
+		octree.SetVoxel(position, value);
+		array_map.setVoxel(position, value);
+	}
+	report("edited");
+
+	octree.Compact();
+	report("compacted");
+
+	// A camera looking across the map, where distant nodes get down to a pixel or less
+	const int width = 256;
+	const int height = 256;
+	const float fov = 1.0f;
+	float pixel_angle = fov / height;
+
+	Vector3f origin(-0.25f * dimension, 0.75f * dimension, -0.25f * dimension);
+	Vector3f forward(1, -0.35f, 1);
+	Vector3f right(1, 0, -1);
+	Vector3f up(0.35f, 1.4142f, 0.35f);
+
+	float forward_length = std::sqrt(forward.x * forward.x + forward.y * forward.y + forward.z * forward.z);
+	float right_length = std::sqrt(right.x * right.x + right.y * right.y + right.z * right.z);
+	float up_length = std::sqrt(up.x * up.x + up.y * up.y + up.z * up.z);
+	float half = std::tan(fov / 2);
+
+	std::vector<Vector3f> directions(width * height);
+	for (int y = 0; y < height; y++) {
+		for (int x = 0; x < width; x++) {
+			float u = ((x + 0.5f) / width * 2 - 1) * half;
+			float v = (1 - (y + 0.5f) / height * 2) * half;
+			directions[x + y * width] = Vector3f(
+				forward.x / forward_length + u * right.x / right_length + v * up.x / up_length,
+				forward.y / forward_length + u * right.y / right_length + v * up.y / up_length,
+				forward.z / forward_length + u * right.z / right_length + v * up.z / up_length
+			);
+		}
+	}
+
+	float max_distance = dimension * 4.0f;
+	std::vector<RayHit> full(width * height);
+	for (size_t i = 0; i < directions.size(); i++)
+		full[i] = octree.CastRay(origin, directions[i], max_distance);
+
+	std::cout << std::endl << "Ray casting, " << width << "x" << height << " camera, cutoff in pixels" << std::endl;
+	BenchmarkTable ray_table({ { "pixels", 12, 1 }, { "rays/s", 16, 0 }, { "hits", 12, 0 }, { "agree %", 12, 2 }, { "mean coverage", 16, 3 } });
+
+	for (float pixels : { 0.0f, 1.0f, 2.0f, 4.0f, 8.0f, 16.0f }) {
+
+		std::vector<RayHit> hits(width * height);
+
+		double start = Now();
+		for (size_t i = 0; i < directions.size(); i++)
+			hits[i] = octree.CastRay(origin, directions[i], max_distance, pixels * pixel_angle);
+		double ray_time = Seconds(start);
+
+		size_t hit_count = 0;
+		size_t agree = 0;
+		double coverage = 0;
+		for (size_t i = 0; i < hits.size(); i++) {
+			hit_count += hits[i].hit;
+			agree += hits[i].hit == full[i].hit;
+			coverage += hits[i].coverage;
+		}
+
+		ray_table.row(pixels, hits.size() / ray_time, hit_count, 100.0 * agree / hits.size(), hit_count ? coverage / hit_count : 0);
+	}
+
+	return all_valid;
+}
+
+bool Benchmark::RegionQueries(unsigned int dimension) {
+
+	SceneFixture fixture(dimension, "terrain");
+	ArrayMap &array_map = fixture.array_map;
+	Octree &octree = fixture.octree;
+
+	Map map(0, 32);
+	map.generateTerrain(dimension, 1);
+
+	// Whatever the map generated, decoded back into one dense array to check against
+	std::vector<char> terrain((size_t)dimension * dimension * dimension, 0);
+	for (auto &chunk : map.chunks) {
+
+		unsigned int size = map.getChunkDimensions();
+		Vector3i origin(chunk.first.x * size, chunk.first.y * size, chunk.first.z * size);
+
+		IntCube region(-origin.x, -origin.y, -origin.z, dimension, dimension, dimension);
+		chunk.second->octree.Decode(region, terrain.data());
+	}
+
+	// Summed volume tables, so the reference count for any cube is 8 lookups
+	size_t side = dimension + 1;
+	auto summed_volume = [&](std::function<char(int, int, int)> voxel) {
+
+		std::vector<uint32_t> table(side * side * side, 0);
+		for (size_t z = 1; z < side; z++)
+			for (size_t y = 1; y < side; y++)
+				for (size_t x = 1; x < side; x++)
+					table[x + side * (y + side * z)] = (voxel(x - 1, y - 1, z - 1) != 0)
+						+ table[x - 1 + side * (y + side * z)] + table[x + side * (y - 1 + side * z)] + table[x + side * (y + side * (z - 1))]
+						- table[x - 1 + side * (y - 1 + side * z)] - table[x - 1 + side * (y + side * (z - 1))] - table[x + side * (y - 1 + side * (z - 1))]
+						+ table[x - 1 + side * (y - 1 + side * (z - 1))];
+		return table;
+	};
+
+	std::vector<uint32_t> octree_table = summed_volume([&](int x, int y, int z) {
+		return array_map.getVoxel(Vector3i(x, y, z));
+	});
+	std::vector<uint32_t> map_table = summed_volume([&](int x, int y, int z) {
+		return terrain[x + dimension * (y + (size_t)dimension * z)];
+	});
+
+	auto reference_count = [&](const std::vector<uint32_t> &table, IntCube cube) {
+
+		IntCube inside;
+		if (!cube.intersects(IntCube(0, 0, 0, dimension, dimension, dimension), inside))
+			return (uint64_t)0;
+
+		auto at = [&](int x, int y, int z) { return (int64_t)table[x + side * (y + side * z)]; };
+		int x0 = inside.left, y0 = inside.top, z0 = inside.front;
+		int x1 = x0 + inside.width, y1 = y0 + inside.height, z1 = z0 + inside.depth;
+
+		return (uint64_t)(at(x1, y1, z1) - at(x0, y1, z1) - at(x1, y0, z1) - at(x1, y1, z0)
+			+ at(x0, y0, z1) + at(x0, y1, z0) + at(x1, y0, z0) - at(x0, y0, z0));
+	};
+
+	// Gameplay sized boxes from a voxel up to 64 on a side, some hanging off the edges
+	const size_t query_count = 1 << 14;
+	std::vector<IntCube> queries(query_count);
+
+	std::mt19937 rng(1234);
+	std::uniform_int_distribution<int> coordinate(-16, dimension);
+	std::uniform_int_distribution<int> extent(1, 64);
+
+	for (size_t i = 0; i < query_count; i++)
+		queries[i] = IntCube(coordinate(rng), coordinate(rng), coordinate(rng), extent(rng), extent(rng), extent(rng));
+
+	std::cout << "Region queries, " << dimension << "^3 terrain, " << query_count << " boxes up to 64 on a side" << std::endl;
+	BenchmarkTable results({ { "source", 12, 0 }, { "query", 10, 0 }, { "queries/s", 16, 0 }, { "voxels/query", 16, 1 }, { "mismatches", 12, 0 } });
+
+	bool valid = true;
+
+	auto report = [&](std::string source, std::string query, double seconds, uint64_t voxels, size_t mismatches) {
+
+		valid &= mismatches == 0;
+		results.row(source, query, query_count / seconds, (double)voxels / query_count, mismatches);
+	};
+
+	auto run = [&](std::string source, const std::vector<uint32_t> &table,
+		std::function<uint64_t(IntCube)> count, std::function<bool(IntCube)> any, std::function<std::vector<OccupiedRegion>(IntCube)> find) {
+
+		std::vector<uint64_t> counts(query_count);
+		double start = Now();
+		for (size_t i = 0; i < query_count; i++)
+			counts[i] = count(queries[i]);
+		double count_time = Seconds(start);
+
+		std::vector<char> anys(query_count);
+		start = Now();
+		for (size_t i = 0; i < query_count; i++)
+			anys[i] = any(queries[i]);
+		double any_time = Seconds(start);
+
+		uint64_t found_voxels = 0;
+		size_t find_mismatches = 0;
+		start = Now();
+		for (size_t i = 0; i < query_count; i++) {
+
+			uint64_t found = 0;
+			for (const OccupiedRegion &region : find(queries[i])) {
+				found += (uint64_t)region.cube.width * region.cube.height * region.cube.depth;
+				find_mismatches += !queries[i].contains(Vector3i(region.cube.left, region.cube.top, region.cube.front)) || region.value == 0;
+			}
+
+			find_mismatches += found != counts[i];
+			found_voxels += found;
+		}
+		double find_time = Seconds(start);
+
+		uint64_t voxels = 0;
+		size_t count_mismatches = 0;
+		size_t any_mismatches = 0;
+		for (size_t i = 0; i < query_count; i++) {
+			uint64_t expected = reference_count(table, queries[i]);
+			voxels += expected;
+			count_mismatches += counts[i] != expected;
+			any_mismatches += (anys[i] != 0) != (expected != 0);
+		}
+
+		report(source, "count", count_time, voxels, count_mismatches);
+		report("", "any", any_time, voxels, any_mismatches);
+		report("", "find", find_time, found_voxels, find_mismatches);
+	};
+
+	run("octree", octree_table,
+		[&](IntCube cube) { return octree.CountOccupied(cube); },
+		[&](IntCube cube) { return octree.AnyOccupied(cube); },
+		[&](IntCube cube) { return octree.FindOccupied(cube); });
+
+	run("map", map_table,
+		[&](IntCube cube) { return map.countOccupied(cube); },
+		[&](IntCube cube) { return map.anyOccupied(cube); },
+		[&](IntCube cube) { return map.findOccupied(cube); });
+
+	// What the same counts cost looking every voxel up, over a sixteenth of the boxes
+	double start = Now();
+	uint64_t scanned = 0;
+	for (size_t i = 0; i < query_count / 16; i++) {
+		IntCube inside;
+		if (!queries[i].intersects(IntCube(0, 0, 0, dimension, dimension, dimension), inside))
+			continue;
+		for (int z = inside.front; z < inside.front + inside.depth; z++)
+			for (int y = inside.top; y < inside.top + inside.height; y++)
+				for (int x = inside.left; x < inside.left + inside.width; x++)
+					scanned += octree.GetVoxel(Vector3i(x, y, z)).value != 0;
+	}
+	double scan_time = Seconds(start) * 16;
+
+	uint64_t expected = 0;
+	for (size_t i = 0; i < query_count / 16; i++)
+		expected += reference_count(octree_table, queries[i]);
+	report("GetVoxel", "count", scan_time, scanned * 16, scanned != expected);
+
+	return valid;
+}
+
+bool Benchmark::BulkEdits(unsigned int dimension) {
+
+	SceneFixture fixture(dimension, "terrain");
+	ArrayMap &array_map = fixture.array_map;
+	Octree &octree = fixture.octree;
+
+	Octree voxel_octree;
+	voxel_octree.Generate(&array_map);
+
+	// The descriptors an edit costs are read off how far the buffers grow, so nothing compacts them
+	octree.auto_compact_growth = 0;
+	voxel_octree.auto_compact_growth = 0;
+
+	// Explosions carving spheres out, and buildings and blobs going up
+	struct Event {
+		bool sphere;
+		IntCube cube;
+		Vector3f center;
+		float radius;
+		char value;
+	};
+
+	const size_t event_count = 128;
+	std::vector<Event> events(event_count);
+
+	std::mt19937 rng(1234);
+	std::uniform_real_distribution<float> coordinate(0.0f, (float)dimension);
+	std::uniform_real_distribution<float> radius(4.0f, 24.0f);
+	std::uniform_int_distribution<int> extent(4, 32);
+	std::uniform_int_distribution<int> material(1, 3);
+
+	for (size_t i = 0; i < event_count; i++) {
+		Event &event = events[i];
+		event.sphere = i % 3 != 1;
+		event.value = i % 3 == 0 ? 0 : (char)material(rng);
+		event.center = Vector3f(coordinate(rng), coordinate(rng), coordinate(rng));
+		event.radius = radius(rng);
+		event.cube = IntCube((int)event.center.x, (int)event.center.y, (int)event.center.z, extent(rng), extent(rng), extent(rng));
+	}
+
+	// Every voxel each event covers, for the reference and the one voxel at a time edits
+	auto covered = [&](const Event &event, std::function<void(Vector3i)> visit) {
+
+		IntCube bounds = event.cube;
+		if (event.sphere) {
+			bounds = IntCube(
+				(int)std::floor(event.center.x - event.radius), (int)std::floor(event.center.y - event.radius), (int)std::floor(event.center.z - event.radius),
+				(int)std::ceil(2 * event.radius) + 2, (int)std::ceil(2 * event.radius) + 2, (int)std::ceil(2 * event.radius) + 2
+			);
+		}
+
+		IntCube inside;
+		if (!bounds.intersects(IntCube(0, 0, 0, dimension, dimension, dimension), inside))
+			return;
+
+		for (int z = inside.front; z < inside.front + inside.depth; z++) {
+			for (int y = inside.top; y < inside.top + inside.height; y++) {
+				for (int x = inside.left; x < inside.left + inside.width; x++) {
+					if (event.sphere) {
+						float dx = x + 0.5f - event.center.x;
+						float dy = y + 0.5f - event.center.y;
+						float dz = z + 0.5f - event.center.z;
+						if (dx * dx + dy * dy + dz * dz > event.radius * event.radius)
+							continue;
+					}
+					visit(Vector3i(x, y, z));
+				}
+			}
+		}
+	};
+
+	uint64_t descriptors = octree.descriptor_buffer.size();
+
+	double start = Now();
+	for (const Event &event : events) {
+		if (event.sphere)
+			octree.FillSphere(event.center, event.radius, event.value);
+		else
+			octree.FillCube(event.cube, event.value);
+	}
+	double bulk_time = Seconds(start);
+
+	uint64_t bulk_descriptors = octree.descriptor_buffer.size() - descriptors;
+
+	uint64_t voxels = 0;
+	start = Now();
+	for (const Event &event : events) {
+		covered(event, [&](Vector3i position) {
+			voxel_octree.SetVoxel(position, event.value);
+			voxels++;
+		});
+	}
+	double voxel_time = Seconds(start);
+
+	uint64_t voxel_descriptors = voxel_octree.descriptor_buffer.size() - descriptors;
+
+	for (const Event &event : events)
+		covered(event, [&](Vector3i position) { array_map.setVoxel(position, event.value); });
+
+	// The level of detail has to come out the same as a tree generated from the edited map
+	Octree reference;
+	reference.Generate(&array_map);
+
+	std::uniform_int_distribution<int> voxel(0, dimension - 1);
+	size_t lod_mismatches = 0;
+	for (size_t i = 0; i < (1 << 16); i++) {
+		Vector3i position(voxel(rng), voxel(rng), voxel(rng));
+		unsigned int depth = i % 8;
+		OctState state = octree.GetVoxel(position, depth);
+		OctState expected = reference.GetVoxel(position, depth);
+		lod_mismatches += state.value != expected.value || state.coverage != expected.coverage;
+	}
+
+	bool bulk_valid = fixture.validate() && lod_mismatches == 0;
+	bool voxel_valid = voxel_octree.Validate(&array_map).valid();
+
+	std::cout << "Bulk edits, " << dimension << "^3 terrain, " << event_count << " spheres and cubes, " << voxels / event_count << " voxels an edit" << std::endl;
+	BenchmarkTable table({ { "edit", 12, 0 }, { "seconds", 14, 6 }, { "edits/s", 14, 0 }, { "descriptors/edit", 18, 0 }, { "valid", 8, 0 } });
+	table.row("bulk", bulk_time, event_count / bulk_time, bulk_descriptors / event_count, bulk_valid);
+	table.row("SetVoxel", voxel_time, event_count / voxel_time, voxel_descriptors / event_count, voxel_valid);
+
+	start = Now();
+	octree.Compact();
+	double compact_time = Seconds(start);
+	bool compact_valid = fixture.validate() && octree.descriptor_buffer.size() == reference.descriptor_buffer.size();
+
+	table.row("compacted", compact_time, "", octree.descriptor_buffer.size(), compact_valid);
+
+	// The same edits on a chunked map centered on the origin, read back out through region queries
+	Map map(0, 32);
+	int offset = dimension / 2;
+
+	ArrayMap expected_map(array_map.getDimensions());
+	for (const Event &event : events) {
+
+		Vector3f center(event.center.x - offset, event.center.y - offset, event.center.z - offset);
+		IntCube cube(event.cube.left - offset, event.cube.top - offset, event.cube.front - offset, event.cube.width, event.cube.height, event.cube.depth);
+
+		if (event.sphere)
+			map.fillSphere(center, event.radius, event.value);
+		else
+			map.fillCube(cube, event.value);
+
+		covered(event, [&](Vector3i position) { expected_map.setVoxel(position, event.value); });
+	}
+
+	ArrayMap found_map(array_map.getDimensions());
+	for (const OccupiedRegion &region : map.findOccupied(IntCube(-offset, -offset, -offset, dimension, dimension, dimension)))
+		for (int z = region.cube.front; z < region.cube.front + region.cube.depth; z++)
+			for (int y = region.cube.top; y < region.cube.top + region.cube.height; y++)
+				for (int x = region.cube.left; x < region.cube.left + region.cube.width; x++)
+					found_map.setVoxel(Vector3i(x + offset, y + offset, z + offset), region.value);
+
+	// Edits near the edge spill out past the reference, so each chunk's voxel count is checked
+	// against its own octree
+	bool map_valid = std::memcmp(found_map.getDataPtr(), expected_map.getDataPtr(), (size_t)dimension * dimension * dimension) == 0;
+	for (auto &chunk : map.chunks)
+		if (chunk.second->voxel_count != chunk.second->octree.CountOccupied(IntCube(0, 0, 0, 32, 32, 32)))
+			map_valid = false;
+
+	table.row("map", "", "", std::to_string(map.getChunkCount()) + " chunks", map_valid);
+
+	return bulk_valid && voxel_valid && compact_valid && map_valid;
+}
+
+bool Benchmark::CursorSteps(unsigned int dimension) {
+
+	SceneFixture fixture(dimension, "terrain");
+	ArrayMap &array_map = fixture.array_map;
+	Octree &octree = fixture.octree;
+
+	const Vector3i neighbours[6] = {
+		Vector3i(1, 0, 0), Vector3i(-1, 0, 0), Vector3i(0, 1, 0),
+		Vector3i(0, -1, 0), Vector3i(0, 0, 1), Vector3i(0, 0, -1)
+	};
+
+	std::cout << "Cursor steps, " << dimension << "^3 terrain, GetVoxel from the root vs OctreeCursor" << std::endl;
+	BenchmarkTable table({ { "walk", 12, 0 }, { "lookups", 12, 0 }, { "GetVoxel q/s", 16, 0 }, { "cursor q/s", 16, 0 }, { "speedup", 10, 2 }, { "valid", 8, 0 } });
+
+	auto report = [&](std::string walk, uint64_t lookups, double voxel_time, double cursor_time, bool valid) {
+		table.row(walk, lookups, lookups / voxel_time, lookups / cursor_time, voxel_time / cursor_time, valid);
+	};
+
+	bool valid = true;
+
+	// Random walk hugging the surface, a step along a random axis at a time
+	{
+		const size_t steps = 1 << 20;
+		std::vector<Vector3i> path(steps);
+
+		std::mt19937 rng(1234);
+		std::uniform_int_distribution<int> direction(0, 5);
+
+		Vector3i position(dimension / 2, dimension / 2, dimension / 2);
+		for (size_t i = 0; i < steps; i++) {
+			Vector3i step = neighbours[direction(rng)];
+			position = Vector3i(
+				std::min(std::max(position.x + step.x, 0), (int)dimension - 1),
+				std::min(std::max(position.y + step.y, 0), (int)dimension - 1),
+				std::min(std::max(position.z + step.z, 0), (int)dimension - 1)
+			);
+			path[i] = position;
+		}
+
+		std::vector<char> expected(steps);
+		std::vector<char> found(steps);
+
+		double start = Now();
+		for (size_t i = 0; i < steps; i++)
+			expected[i] = octree.GetVoxel(path[i]).value;
+		double voxel_time = Seconds(start);
+
+		start = Now();
+		OctreeCursor cursor(&octree, path[0]);
+		for (size_t i = 0; i < steps; i++)
+			found[i] = cursor.MoveTo(path[i]);
+		double cursor_time = Seconds(start);
+
+		bool walk_valid = expected == found;
+		for (size_t i = 0; i < steps && walk_valid; i += 97)
+			walk_valid = expected[i] == array_map.getVoxel(path[i]);
+
+		report("random", steps, voxel_time, cursor_time, walk_valid);
+		valid &= walk_valid;
+	}
+
+	// Counting the set neighbours of every voxel in a slab through the surface, where the
+	// cursor goes out to each neighbour and back
+	{
+		int top = (int)dimension / 4;
+		int height = (int)dimension / 2;
+		uint64_t lookups = (uint64_t)dimension * height * dimension * 6;
+
+		uint64_t expected = 0;
+		double start = Now();
+		for (int z = 0; z < (int)dimension; z++)
+			for (int y = top; y < top + height; y++)
+				for (int x = 0; x < (int)dimension; x++)
+					for (const Vector3i &n : neighbours) {
+						Vector3i p(x + n.x, y + n.y, z + n.z);
+						if (p.x >= 0 && p.z >= 0 && p.x < (int)dimension && p.z < (int)dimension)
+							expected += octree.GetVoxel(p).value != 0;
+					}
+		double voxel_time = Seconds(start);
+
+		uint64_t found = 0;
+		start = Now();
+		OctreeCursor cursor(&octree);
+		for (int z = 0; z < (int)dimension; z++)
+			for (int y = top; y < top + height; y++)
+				for (int x = 0; x < (int)dimension; x++)
+					for (const Vector3i &n : neighbours)
+						found += cursor.MoveTo(Vector3i(x + n.x, y + n.y, z + n.z)) != 0;
+		double cursor_time = Seconds(start);
+
+		uint64_t reference = 0;
+		for (int z = 0; z < (int)dimension; z++)
+			for (int y = top; y < top + height; y++)
+				for (int x = 0; x < (int)dimension; x++)
+					for (const Vector3i &n : neighbours) {
+						Vector3i p(x + n.x, y + n.y, z + n.z);
+						if (p.x >= 0 && p.z >= 0 && p.x < (int)dimension && p.z < (int)dimension)
+							reference += array_map.getVoxel(p) != 0;
+					}
+
+		report("neighbours", lookups, voxel_time, cursor_time, expected == found && found == reference);
+		valid &= expected == found && found == reference;
+	}
+
+	// Flood fill of the air over the terrain from the top corner, breadth first
+	{
+		auto flood = [&](std::function<char(Vector3i)> lookup, uint64_t* lookups) {
+
+			std::vector<bool> visited((size_t)dimension * dimension * dimension);
+			std::deque<Vector3i> queue;
+
+			Vector3i seed(0, dimension - 1, 0);
+			queue.push_back(seed);
+			visited[((size_t)seed.z * dimension + seed.y) * dimension + seed.x] = true;
+
+			uint64_t filled = 0;
+			while (!queue.empty()) {
+
+				Vector3i position = queue.front();
+				queue.pop_front();
+				filled++;
+
+				for (const Vector3i &n : neighbours) {
+					Vector3i next(position.x + n.x, position.y + n.y, position.z + n.z);
+					if (next.x < 0 || next.y < 0 || next.z < 0 || next.x >= (int)dimension || next.y >= (int)dimension || next.z >= (int)dimension)
+						continue;
+
+					size_t index = ((size_t)next.z * dimension + next.y) * dimension + next.x;
+					if (visited[index])
+						continue;
+
+					(*lookups)++;
+					if (lookup(next) != 0)
+						continue;
+
+					visited[index] = true;
+					queue.push_back(next);
+				}
+			}
+
+			return filled;
+		};
+
+		uint64_t lookups = 0;
+		double start = Now();
+		uint64_t expected = flood([&](Vector3i next) { return octree.GetVoxel(next).value; }, &lookups);
+		double voxel_time = Seconds(start);
+
+		lookups = 0;
+		start = Now();
+		OctreeCursor cursor(&octree);
+		uint64_t found = flood([&](Vector3i next) { return cursor.MoveTo(next); }, &lookups);
+		double cursor_time = Seconds(start);
+
+		uint64_t air = 0;
+		for (int z = 0; z < (int)dimension; z++)
+			for (int y = 0; y < (int)dimension; y++)
+				for (int x = 0; x < (int)dimension; x++)
+					air += array_map.getVoxel(Vector3i(x, y, z)) == 0;
+
+		// The terrain has no overhangs so all of the air is connected to the sky
+		report("flood fill", lookups, voxel_time, cursor_time, expected == found && found == air);
+		valid &= expected == found && found == air;
+	}
+
+	// Edits under a cursor, it has to notice and start over from the new root
+	{
+		std::mt19937 rng(4321);
+		std::uniform_int_distribution<int> voxel(0, dimension - 1);
+		std::uniform_int_distribution<int> material(0, 3);
+
+		OctreeCursor cursor(&octree);
+		size_t mismatches = 0;
+		for (size_t i = 0; i < 4096; i++) {
+
+			Vector3i position(voxel(rng), voxel(rng), voxel(rng));
+			if (i % 4 == 0)
+				octree.SetVoxel(position, (char)material(rng));
+			if (i % 512 == 0)
+				octree.Compact();
+
+			mismatches += cursor.MoveTo(position) != octree.GetVoxel(position).value;
+			mismatches += cursor.Move(Vector3i(0, 1, 0)) != (position.y + 1 < (int)dimension ? octree.GetVoxel(Vector3i(position.x, position.y + 1, position.z)).value : 0);
+		}
+
+		table.row("edited", 8192, "", "", "", mismatches == 0);
+		valid &= mismatches == 0;
+	}
+
+	return valid;
+}
+
+bool Benchmark::DistanceFields(unsigned int dimension) {
+
+	unsigned int thread_count = std::max(1u, std::thread::hardware_concurrency());
+	bool valid = true;
+
+	std::cout << "Distance fields of terrain maps, exact field at 1 and " << thread_count << " threads" << std::endl;
+	BenchmarkTable table({ { "map", 8, 0 }, { "1 thread s", 12, 4 }, { "threads s", 12, 4 }, { "speedup", 10, 2 },
+		{ "field MiB", 12, 2 }, { "bounds s", 12, 4 }, { "bounds KiB", 12, 1 }, { "tightness", 10, 2 }, { "valid", 8, 0 } });
+
+	for (unsigned int size = 32; size <= dimension; size *= 2) {
+
+		SceneFixture fixture(size, "terrain");
+		ArrayMap &array_map = fixture.array_map;
+		Octree &octree = fixture.octree;
+
+		IntCube whole(0, 0, 0, size, size, size);
+		uint64_t count = (uint64_t)size * size * size;
+
+		std::vector<float> field(count);
+		std::vector<float> threaded_field(count);
+
+		double start = Now();
+		octree.DistanceField(whole, field.data(), 1);
+		double field_time = Seconds(start);
+
+		start = Now();
+		octree.DistanceField(whole, threaded_field.data(), thread_count);
+		double threaded_time = Seconds(start);
+
+		bool field_valid = field == threaded_field;
+
+		// Brute force the nearest set voxel for a sample of voxels, looking only as far out as
+		// the field says it is plus a voxel
+		std::mt19937 rng(1234);
+		std::uniform_int_distribution<int> voxel(0, size - 1);
+
+		for (int i = 0; i < 32 && field_valid; i++) {
+
+			Vector3i p(voxel(rng), voxel(rng), voxel(rng));
+			float distance = field[p.x + (uint64_t)size * (p.y + (uint64_t)size * p.z)];
+			int reach = (int)std::ceil(distance) + 1;
+
+			float nearest = std::numeric_limits<float>::infinity();
+			for (int z = std::max(0, p.z - reach); z <= std::min((int)size - 1, p.z + reach); z++)
+				for (int y = std::max(0, p.y - reach); y <= std::min((int)size - 1, p.y + reach); y++)
+					for (int x = std::max(0, p.x - reach); x <= std::min((int)size - 1, p.x + reach); x++)
+						if (array_map.getVoxel(Vector3i(x, y, z)))
+							nearest = std::min(nearest, std::sqrt((float)((x - p.x) * (x - p.x) + (y - p.y) * (y - p.y) + (z - p.z) * (z - p.z))));
+
+			field_valid = std::fabs(nearest - distance) < 1e-3f;
+		}
+
+		start = Now();
+		octree.BuildDistanceBounds(thread_count);
+		double bounds_time = Seconds(start);
+
+		// The bounds can't ever be more than the exact distance, and how close they come to it
+		double bound_total = 0;
+		double exact_total = 0;
+		bool bounds_valid = true;
+		for (int i = 0; i < 4096; i++) {
+
+			Vector3i p(voxel(rng), voxel(rng), voxel(rng));
+			float distance = field[p.x + (uint64_t)size * (p.y + (uint64_t)size * p.z)];
+			float clearance = octree.Clearance(p);
+
+			bounds_valid &= clearance <= distance;
+			bound_total += clearance;
+			exact_total += std::min(distance, 255.0f);
+		}
+
+		table.row(size, field_time, threaded_time, field_time / threaded_time, count * sizeof(float) / (1024.0 * 1024.0), bounds_time,
+			octree.distance_buffer.memory_usage() / 1024.0, exact_total > 0 ? bound_total / exact_total : 1, field_valid && bounds_valid);
+
+		valid &= field_valid && bounds_valid;
+	}
+
+	// Clearance for agents of a few voxels across just over the surface. The bounds settle the
+	// query when they reach the agents radius, otherwise it takes something exact
+	SceneFixture fixture(dimension, "terrain");
+	ArrayMap &array_map = fixture.array_map;
+	Octree &octree = fixture.octree;
+	octree.BuildDistanceBounds(thread_count);
+
+	std::vector<float> field((uint64_t)dimension * dimension * dimension);
+	octree.DistanceField(IntCube(0, 0, 0, dimension, dimension, dimension), field.data(), thread_count);
+
+	const size_t query_count = 1 << 18;
+	std::vector<Vector3i> positions(query_count);
+
+	std::mt19937 rng(4321);
+	std::uniform_int_distribution<int> column(0, dimension - 1);
+	std::uniform_int_distribution<int> above(1, 16);
+
+	for (size_t i = 0; i < query_count; i++) {
+
+		int x = column(rng);
+		int z = column(rng);
+		int surface = dimension - 1;
+		while (surface > 0 && array_map.getVoxel(Vector3i(x, surface, z)) == 0)
+			surface--;
+
+		positions[i] = Vector3i(x, std::min(surface + above(rng), (int)dimension - 1), z);
+	}
+
+	double start = Now();
+	std::vector<float> clearances(query_count);
+	for (size_t i = 0; i < query_count; i++)
+		clearances[i] = octree.Clearance(positions[i]);
+	double clearance_time = Seconds(start);
+
+	start = Now();
+	char set = 0;
+	for (size_t i = 0; i < query_count; i++)
+		set |= octree.GetVoxel(positions[i]).value;
+	double voxel_time = Seconds(start);
+
+	std::cout << "Clearance just over " << dimension << "^3 terrain, " << query_count << " queries at " << std::fixed << std::setprecision(0)
+		<< query_count / clearance_time << " q/s, GetVoxel " << query_count / voxel_time << " q/s" << std::endl;
+	BenchmarkTable clearance_table({ { "radius", 8, 0 }, { "clear", 12, 0 }, { "settled by bound", 18, 0 }, { "valid", 8, 0 } });
+
+	for (float radius = 1; radius <= 8; radius *= 2) {
+
+		size_t clear = 0;
+		size_t settled = 0;
+		bool radius_valid = true;
+
+		for (size_t i = 0; i < query_count; i++) {
+
+			Vector3i p = positions[i];
+			float distance = field[p.x + (uint64_t)dimension * (p.y + (uint64_t)dimension * p.z)];
+
+			clear += distance >= radius;
+			settled += clearances[i] >= radius;
+			radius_valid &= clearances[i] <= distance;
+		}
+
+		clearance_table.row(radius, clear, settled, radius_valid);
+
+		valid &= radius_valid;
+	}
+
+	return valid;
+}
+
+bool Benchmark::MeshExtraction(unsigned int dimension) {
+
+	unsigned int thread_count = std::max(1u, std::thread::hardware_concurrency());
+	bool valid = true;
+
+	std::cout << "Mesh extraction from terrain maps, 32^3 chunks at 1 and " << thread_count << " threads" << std::endl;
+	BenchmarkTable table({ { "map", 8, 0 }, { "1 thread s", 12, 4 }, { "threads s", 12, 4 }, { "ms/Mvoxel", 14, 2 },
+		{ "faces", 12, 0 }, { "triangles", 12, 0 }, { "merged", 10, 2 }, { "valid", 8, 0 } });
+
+	for (unsigned int size = 32; size <= dimension; size *= 2) {
+
+		SceneFixture fixture(size, "terrain");
+		ArrayMap &array_map = fixture.array_map;
+		Octree &octree = fixture.octree;
+
+		IntCube whole(0, 0, 0, size, size, size);
+
+		double start = Now();
+		Mesh mesh = octree.ExtractMesh(whole, 1);
+		double mesh_time = Seconds(start);
+
+		start = Now();
+		Mesh threaded_mesh = octree.ExtractMesh(whole, thread_count);
+		double threaded_time = Seconds(start);
+
+		bool mesh_valid = mesh.vertices == threaded_mesh.vertices && mesh.indices == threaded_mesh.indices;
+
+		// Exposed faces facing each way, counted voxel by voxel with the outside of the map empty
+		auto voxel = [&](int x, int y, int z) {
+			if (x < 0 || y < 0 || z < 0 || x >= (int)size || y >= (int)size || z >= (int)size)
+				return (char)0;
+			return array_map.getVoxel(Vector3i(x, y, z));
+		};
+
+		const Vector3i directions[6] = {
+			Vector3i(-1, 0, 0), Vector3i(1, 0, 0), Vector3i(0, -1, 0),
+			Vector3i(0, 1, 0), Vector3i(0, 0, -1), Vector3i(0, 0, 1)
+		};
+
+		uint64_t faces[6] = { 0 };
+		for (int z = 0; z < (int)size; z++)
+			for (int y = 0; y < (int)size; y++)
+				for (int x = 0; x < (int)size; x++)
+					if (voxel(x, y, z))
+						for (int d = 0; d < 6; d++)
+							faces[d] += voxel(x + directions[d].x, y + directions[d].y, z + directions[d].z) == 0;
+
+		// The quads have to cover the same area facing each way, and each one has to sit on a
+		// voxel of its value with nothing in front of it
+		uint64_t area[6] = { 0 };
+		for (size_t quad = 0; quad < mesh.quadCount(); quad++) {
+
+			const Vector3f &first = mesh.vertices[quad * 4];
+			const Vector3f &opposite = mesh.vertices[quad * 4 + 2];
+			const Vector3f &normal = mesh.normals[quad * 4];
+
+			int axis = normal.x != 0 ? 0 : (normal.y != 0 ? 1 : 2);
+			int direction = (int)(&normal.x)[axis];
+
+			float extent[3] = { std::fabs(opposite.x - first.x), std::fabs(opposite.y - first.y), std::fabs(opposite.z - first.z) };
+			extent[axis] = 1;
+			area[axis * 2 + (direction > 0)] += (uint64_t)(extent[0] * extent[1] * extent[2]);
+
+			float center[3] = { (first.x + opposite.x) / 2, (first.y + opposite.y) / 2, (first.z + opposite.z) / 2 };
+			center[axis] -= direction * 0.5f;
+			Vector3i behind((int)std::floor(center[0]), (int)std::floor(center[1]), (int)std::floor(center[2]));
+
+			mesh_valid &= voxel(behind.x, behind.y, behind.z) == mesh.values[quad] &&
+				voxel(behind.x + (int)normal.x, behind.y + (int)normal.y, behind.z + (int)normal.z) == 0;
+		}
+
+		uint64_t face_count = 0;
+		for (int d = 0; d < 6; d++) {
+			mesh_valid &= area[d] == faces[d];
+			face_count += faces[d];
+		}
+
+		double voxels = (double)size * size * size / 1e6;
+
+		table.row(size, mesh_time, threaded_time, threaded_time * 1000 / voxels, face_count, mesh.triangleCount(),
+			face_count * 2.0 / std::max((size_t)1, mesh.triangleCount()), mesh_valid);
+
+		valid &= mesh_valid;
+
+		if (size == 32) {
+
+			std::string file_name = "mesh_benchmark.obj";
+			bool saved = mesh.saveObj(file_name);
+
+			std::ifstream file(file_name, std::ios::binary | std::ios::ate);
+			std::cout << std::setw(8) << "OBJ" << std::setw(12) << (saved ? (uint64_t)file.tellg() : 0) << " bytes" << std::endl;
+			file.close();
+			std::remove(file_name.c_str());
+
+			valid &= saved;
+		}
+	}
+
+	return valid;
+}
+
+bool Benchmark::ComponentLabelling(unsigned int dimension) {
+
+	SceneFixture fixture(dimension, "terrain");
+	ArrayMap &array_map = fixture.array_map;
+	Octree &octree = fixture.octree;
+
+	// Floating islands up in the sky and cavities hollowed out underground, the same edits
+	// made to the map to check against
+	std::mt19937 rng(1234);
+	std::uniform_int_distribution<int> coordinate(0, dimension - 1);
+	std::uniform_int_distribution<int> extent(2, std::max(2, (int)dimension / 16));
+	std::uniform_int_distribution<int> material(1, 3);
+
+	auto fill = [&](IntCube cube, char value) {
+
+		octree.FillCube(cube, value);
+
+		IntCube inside;
+		if (!cube.intersects(IntCube(0, 0, 0, dimension, dimension, dimension), inside))
+			return;
+
+		for (int z = inside.front; z < inside.front + inside.depth; z++)
+			for (int y = inside.top; y < inside.top + inside.height; y++)
+				for (int x = inside.left; x < inside.left + inside.width; x++)
+					array_map.setVoxel(Vector3i(x, y, z), value);
+	};
+
+	for (int i = 0; i < 32; i++) {
+		int size = extent(rng);
+		fill(IntCube(coordinate(rng), (int)dimension * 7 / 8 - size, coordinate(rng), size, size, size), (char)material(rng));
+	}
+	for (int i = 0; i < 32; i++) {
+		int size = extent(rng);
+		fill(IntCube(coordinate(rng), 1 + coordinate(rng) % (dimension / 8), coordinate(rng), size, size, size), 0);
+	}
+
+	// Breadth first flood fill of every voxel over the map, the reference
+	auto flood = [&](bool empty) {
+
+		std::vector<uint32_t> labels((size_t)dimension * dimension * dimension, 0xFFFFFFFF);
+		std::vector<ConnectedComponent> components;
+		std::deque<Vector3i> queue;
+
+		const Vector3i neighbours[6] = {
+			Vector3i(1, 0, 0), Vector3i(-1, 0, 0), Vector3i(0, 1, 0),
+			Vector3i(0, -1, 0), Vector3i(0, 0, 1), Vector3i(0, 0, -1)
+		};
+
+		auto index = [&](Vector3i p) { return ((size_t)p.z * dimension + p.y) * dimension + p.x; };
+		auto labelled = [&](Vector3i p) { return (array_map.getVoxel(p) == 0) == empty; };
+
+		for (int z = 0; z < (int)dimension; z++) {
+			for (int y = 0; y < (int)dimension; y++) {
+				for (int x = 0; x < (int)dimension; x++) {
+
+					Vector3i seed(x, y, z);
+					if (!labelled(seed) || labels[index(seed)] != 0xFFFFFFFF)
+						continue;
+
+					uint32_t label = (uint32_t)components.size();
+					int low[3] = { x, y, z };
+					int high[3] = { x, y, z };
+					uint64_t voxels = 0;
+
+					labels[index(seed)] = label;
+					queue.push_back(seed);
+
+					while (!queue.empty()) {
+
+						Vector3i p = queue.front();
+						queue.pop_front();
+						voxels++;
+
+						for (int a = 0; a < 3; a++) {
+							low[a] = std::min(low[a], (&p.x)[a]);
+							high[a] = std::max(high[a], (&p.x)[a]);
+						}
+
+						for (const Vector3i &n : neighbours) {
+							Vector3i next(p.x + n.x, p.y + n.y, p.z + n.z);
+							if (next.x < 0 || next.y < 0 || next.z < 0 || next.x >= (int)dimension || next.y >= (int)dimension || next.z >= (int)dimension)
+								continue;
+							if (!labelled(next) || labels[index(next)] != 0xFFFFFFFF)
+								continue;
+
+							labels[index(next)] = label;
+							queue.push_back(next);
+						}
+					}
+
+					components.push_back(ConnectedComponent{ IntCube(low[0], low[1], low[2], high[0] - low[0] + 1, high[1] - low[1] + 1, high[2] - low[2] + 1), voxels });
+				}
+			}
+		}
+
+		return components;
+	};
+
+	// Components come out numbered in different orders, so they're compared as sorted lists
+	auto sorted = [](std::vector<ConnectedComponent> components) {
+		std::vector<std::tuple<int, int, int, int, int, int, uint64_t>> list;
+		for (const ConnectedComponent &c : components)
+			list.push_back(std::make_tuple(c.bounds.left, c.bounds.top, c.bounds.front, c.bounds.width, c.bounds.height, c.bounds.depth, c.voxels));
+		std::sort(list.begin(), list.end());
+		return list;
+	};
+
+	unsigned int thread_count = std::max(1u, std::thread::hardware_concurrency());
+	bool valid = true;
+
+	std::cout << "Connected components, " << dimension << "^3 terrain with floating islands and cavities" << std::endl;
+	BenchmarkTable table({ { "space", 8, 0 }, { "cubes", 12, 0 }, { "components", 12, 0 }, { "1 thread s", 12, 4 },
+		{ "threads s", 12, 4 }, { "flood s", 12, 4 }, { "speedup", 10, 2 }, { "special", 10, 0 }, { "valid", 8, 0 } });
+
+	for (int empty = 0; empty < 2; empty++) {
+
+		double start = Now();
+		ComponentLabels labels = octree.ConnectedComponents(empty != 0, 1);
+		double label_time = Seconds(start);
+
+		start = Now();
+		ComponentLabels threaded_labels = octree.ConnectedComponents(empty != 0, thread_count);
+		double threaded_time = Seconds(start);
+
+		start = Now();
+		std::vector<ConnectedComponent> reference = flood(empty != 0);
+		double flood_time = Seconds(start);
+
+		bool labels_valid = labels.labels == threaded_labels.labels &&
+			sorted(labels.components) == sorted(reference) && sorted(threaded_labels.components) == sorted(reference);
+
+		// Islands not reaching down to the ground, or cavities not reaching the edge of the map
+		size_t special = 0;
+		for (const ConnectedComponent &c : labels.components) {
+			if (empty)
+				special += c.bounds.left > 0 && c.bounds.top > 0 && c.bounds.front > 0 &&
+					c.bounds.left + c.bounds.width < (int)dimension && c.bounds.top + c.bounds.height < (int)dimension && c.bounds.front + c.bounds.depth < (int)dimension;
+			else
+				special += c.bounds.top > 0;
+		}
+
+		table.row(empty ? "empty" : "set", labels.cubes.size(), labels.components.size(), label_time, threaded_time, flood_time,
+			flood_time / label_time, special, labels_valid);
+
+		valid &= labels_valid;
+	}
+
+	return valid;
+}
+
+RayHit Benchmark::DDACastRay(ArrayMap* array_map, Vector3f origin, Vector3f direction, float max_distance) {
+
+	RayHit result;
+	Vector3i dim = array_map->getDimensions();
+
+	float length = std::sqrt(direction.x * direction.x + direction.y * direction.y + direction.z * direction.z);
+	float o[3] = { origin.x, origin.y, origin.z };
+	float d[3] = { direction.x / length, direction.y / length, direction.z / length };
+	int size[3] = { dim.x, dim.y, dim.z };
+
+	// Clip to the map so rays starting outside of it begin at its surface
+	float t = 0;
+	float t_end = max_distance;
+	for (int a = 0; a < 3; a++) {
+		if (d[a] == 0) {
+			if (o[a] < 0 || o[a] >= size[a])
+				return result;
+			continue;
+		}
+		float t0 = (0 - o[a]) / d[a];
+		float t1 = (size[a] - o[a]) / d[a];
+		t = std::max(t, std::min(t0, t1));
+		t_end = std::min(t_end, std::max(t0, t1));
+	}
+	if (t > t_end)
+		return result;
+
+	int voxel[3];
+	int step[3];
+	float t_max[3];
+	float t_delta[3];
+	int entry_axis = -1;
+
+	for (int a = 0; a < 3; a++) {
+		voxel[a] = std::min(std::max((int)std::floor(o[a] + d[a] * t), 0), size[a] - 1);
+		step[a] = d[a] > 0 ? 1 : -1;
+		t_delta[a] = d[a] != 0 ? std::fabs(1.0f / d[a]) : INFINITY;
+		float boundary = voxel[a] + (d[a] > 0 ? 1 : 0);
+		t_max[a] = d[a] != 0 ? (boundary - o[a]) / d[a] : INFINITY;
+	}
+
+	// The ray enters the map through whichever face it crossed last
+	if (t > 0) {
+		for (int a = 0; a < 3; a++)
+			if (d[a] != 0 && std::fabs(t - ((d[a] > 0 ? 0 : size[a]) - o[a]) / d[a]) < 1e-6f)
+				entry_axis = a;
+	}
+
+	while (t <= t_end) {
+
+		char value = array_map->getVoxel(Vector3i(voxel[0], voxel[1], voxel[2]));
+		if (value) {
+			result.hit = true;
+			result.distance = t;
+			result.value = value;
+			result.voxel = Vector3i(voxel[0], voxel[1], voxel[2]);
+			if (entry_axis >= 0)
+				(&result.normal.x)[entry_axis] = -step[entry_axis];
+			return result;
+		}
+
+		int a = t_max[0] < t_max[1] ? (t_max[0] < t_max[2] ? 0 : 2) : (t_max[1] < t_max[2] ? 1 : 2);
+		t = t_max[a];
+		t_max[a] += t_delta[a];
+		voxel[a] += step[a];
+		entry_axis = a;
+
+		if (voxel[a] < 0 || voxel[a] >= size[a])
+			return result;
+	}
+
+	return result;
+}
@@ -0,0 +1,116 @@
+#pragma once
+#include <string>
+#include "ArrayMap.h"
+#include "ChunkManager.h"
+#include "Fixture.h"
+#include "Map.h"
+#include "Octree.h"
+#include "OctreeCursor.h"
+
+class Benchmark {
+
+public:
+
+	// Runs the named benchmark on a map of the given dimension, returns false if the
+	// benchmark doesn't exist or failed to produce correct results
+	static bool Run(std::string name, unsigned int dimension);
+
+	// Times Octree::Generate at 1, 2, 4, 8 and 16 threads and reports the speedup over
+	// the single threaded build
+	static bool OctreeGeneration(unsigned int dimension);
+
+	// Compares looping Octree::GetVoxel against the batched Octree::GetVoxels on maps from
+	// 32^3 up to dimension^3, for random and for linear sweeps of positions
+	static bool VoxelQueries(unsigned int dimension);
+
+	// Rays per second through Octree::CastRay against a brute force DDA over the ArrayMap,
+	// checking that both find the same voxels
+	static bool RayCasting(unsigned int dimension);
+
+	// Bytes held by the dense ArrayMap against the octree and its attachments, for random
+	// and terrain maps from 32^3 up to dimension^3
+	static bool MemoryUsage(unsigned int dimension);
+
+	// Edits per second through Octree::SetVoxel on a terrain map, and what a million random
+	// edits leave the tree looking like before and after Octree::Compact
+	static bool VoxelEdits(unsigned int dimension);
+
+	// Time to Save a tree and Load it back against generating it, for a random and a
+	// terrain map. The loaded tree is validated against the map it came from
+	static bool SaveAndLoad(unsigned int dimension);
+
+	// Random queries against a tree streamed from a file with page caches from an eighth
+	// of its descriptor pages up to all of them, with the cache hit rates. The queries run one
+	// at a time, batched, and split over every hardware thread sharing the cache
+	static bool Streaming(unsigned int dimension);
+
+	// Bytes held by the tree before and after Octree::Deduplicate turns it into a DAG, for
+	// random and terrain maps from 32^3 up to dimension^3
+	static bool Deduplication(unsigned int dimension);
+
+	// Octree::Validate at 1 to 8 threads against looking every voxel up with GetVoxel, then
+	// breaks some voxels and checks they're all reported
+	static bool Validation(unsigned int dimension);
+
+	// Octree::Decode of the whole tree at 1 to 8 threads and of an unaligned region, against a
+	// GetVoxel for every voxel, checking the decoded data matches the map
+	static bool Decoding(unsigned int dimension);
+
+	// Octree::Generate and Validate, and random single voxel and 2^3 block reads, against
+	// ArrayMaps in each of the layouts, for a random and a terrain map, with the bytes each
+	// layout takes
+	static bool MapLayouts(unsigned int dimension);
+
+	// Sets and gets through a Map with chunks dimension on a side, for balls scattered far
+	// apart, with how much memory the chunks take before and after compacting. Clearing the balls should drop every chunk
+	static bool ChunkedMap(unsigned int dimension);
+
+	// Map::generateTerrain of a dimension^3 cube at 1 to 8 threads for two seeds, with and
+	// without caves, checking each seed comes out the same at every thread count
+	static bool TerrainGeneration(unsigned int dimension);
+
+	// A ChunkManager following a focus out across terrain dimension high and back under a
+	// small budget, with its residency, queue and eviction stats along the way. The chunks
+	// read back off the disk have to match the terrain
+	static bool ChunkResidency(unsigned int dimension);
+
+	// Octree::GetVoxel stopped at every depth against how much of each node the map really has
+	// set, for a generated, edited and compacted tree, then a camera's worth of CastRay with
+	// cutoffs from a pixel up to 16
+	static bool LevelOfDetail(unsigned int dimension);
+
+	// Octree and Map region counts, any tests and uniform cube lists for thousands of small
+	// boxes on a terrain map, checked against summed volume tables of the voxels, and the
+	// counts again through GetVoxel on every voxel
+	static bool RegionQueries(unsigned int dimension);
+
+	// Octree::FillSphere and FillCube explosions and buildings on a terrain map against
+	// setting the same voxels one at a time, then the same edits on a chunked Map
+	static bool BulkEdits(unsigned int dimension);
+
+	// OctreeCursor against GetVoxel from the root for a random walk, sampling the neighbours of
+	// a slab of voxels and a flood fill of the air over a terrain map, then with edits in between
+	static bool CursorSteps(unsigned int dimension);
+
+	// Octree::DistanceField at 1 and every hardware thread and BuildDistanceBounds for terrain
+	// maps from 32^3 up to dimension^3, with their times and sizes, checked against brute force.
+	// Then how many clearance queries over the terrain the bounds settle alone
+	static bool DistanceFields(unsigned int dimension);
+
+	// Octree::ExtractMesh at 1 and every hardware thread for terrain maps from 32^3 up to
+	// dimension^3, with the time per million voxels and how many triangles greedy merging saves.
+	// The quads have to cover exactly the exposed faces of the map
+	static bool MeshExtraction(unsigned int dimension);
+
+	// Octree::ConnectedComponents of the set and the empty voxels of a terrain map with floating
+	// islands and buried cavities, at 1 and every hardware thread, against a flood fill of every
+	// voxel. The components have to come out with the same bounds and voxel counts
+	static bool ComponentLabelling(unsigned int dimension);
+
+private:
+
+	Benchmark() {};
+
+	// Amanatides & Woo voxel walk straight over the dense array, the reference for CastRay
+	static RayHit DDACastRay(ArrayMap* array_map, Vector3f origin, Vector3f direction, float max_distance);
+};
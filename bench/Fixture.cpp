@@ -0,0 +1,38 @@
+#include <chrono>
+#include "Fixture.h"
+
+SceneFixture::SceneFixture(unsigned int dimension, std::string scene, VoxelLayout layout) :
+	array_map(Vector3i(dimension, dimension, dimension), layout) {
+
+	if (scene == "terrain")
+		array_map.fillTerrain();
+	else
+		array_map.fillRandom(1);
+
+	double start = Now();
+	octree.Generate(&array_map);
+	generate_time = Seconds(start);
+}
+
+bool SceneFixture::validate() {
+	return octree.Validate(&array_map).valid();
+}
+
+BenchmarkTable::BenchmarkTable(std::initializer_list<TableColumn> columns) : columns(columns) {
+
+	for (const TableColumn &column : this->columns)
+		std::cout << std::setw(column.width) << column.name;
+	std::cout << std::endl;
+}
+
+void BenchmarkTable::cell(size_t column, const bool &value) {
+	std::cout << std::setw(columns[column].width) << (value ? "yes" : "no");
+}
+
+double Now() {
+	return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+double Seconds(double start) {
+	return Now() - start;
+}
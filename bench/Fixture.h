@@ -0,0 +1,73 @@
+#pragma once
+#include <initializer_list>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "ArrayMap.h"
+#include "Octree.h"
+
+// What most of the benchmarks start from, a dimension^3 map of one of the scenes and the tree
+// generated from it. "random" is fillRandom(1), "terrain" is fillTerrain()
+struct SceneFixture {
+
+	SceneFixture(unsigned int dimension, std::string scene, VoxelLayout layout = VoxelLayout::Linear);
+
+	// Whether the tree still holds exactly the voxels of the map, after whatever the benchmark
+	// did to both of them
+	bool validate();
+
+	ArrayMap array_map;
+	Octree octree;
+
+	// Seconds the first Generate took
+	double generate_time;
+};
+
+// A column of a BenchmarkTable, right aligned to width. Floating point values are printed
+// fixed with precision decimals
+struct TableColumn {
+
+	std::string name;
+	int width;
+	int precision;
+};
+
+// Prints a benchmark's results as right aligned columns, the header as soon as it's made
+class BenchmarkTable {
+
+public:
+
+	BenchmarkTable(std::initializer_list<TableColumn> columns);
+
+	// One value per column from the left, bools print as yes or no. A row can stop short
+	template <typename... Values>
+	void row(const Values&... values);
+
+private:
+
+	template <typename Value>
+	void cell(size_t column, const Value &value);
+	void cell(size_t column, const bool &value);
+
+	std::vector<TableColumn> columns;
+};
+
+template <typename... Values>
+void BenchmarkTable::row(const Values&... values) {
+
+	size_t column = 0;
+	int expand[] = { 0, (cell(column++, values), 0)... };
+	(void)expand;
+
+	std::cout << std::endl;
+}
+
+template <typename Value>
+void BenchmarkTable::cell(size_t column, const Value &value) {
+	std::cout << std::setw(columns[column].width) << std::fixed << std::setprecision(columns[column].precision) << value;
+}
+
+// Seconds on a monotonic clock, differences between them time the benchmarks
+double Now();
+double Seconds(double start);
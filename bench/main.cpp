@@ -0,0 +1,21 @@
+/**
+ * Benchmarks, each one timing a part of the library against the simplest way of doing the
+ * same thing and checking that both give the same results
+ *
+ * OctalotBench <name> [dimension]
+ */
+
+#include <iostream>
+#include <string>
+#include "Benchmark.h"
+
+int main(int argc, char* argv[]) {
+
+	if (argc < 2) {
+		std::cout << "OctalotBench <name> [dimension]" << std::endl;
+		return 1;
+	}
+
+	unsigned int dimension = argc > 2 ? std::stoi(argv[2]) : 64;
+	return Benchmark::Run(argv[1], dimension) ? 0 : 1;
+}
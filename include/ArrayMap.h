@@ -5,17 +5,70 @@
 #include "util.hpp"
 #include "Vector3.hpp"
 
+// How ArrayMap lays its voxels out in memory
+enum class VoxelLayout {
+
+	// x + width * (y + height * z), rows of x one after another
+	Linear,
+
+	// Z-order, the bits of x, y and z interleaved the same way the octree numbers its
+	// children. The data is padded out to a power of 2 cube
+	Morton,
+
+	// 8^3 bricks laid out linearly, each brick linear inside. The data is padded out to a
+	// multiple of 8 on each axis
+	Bricked,
+
+	// One bit per voxel, anything that isn't 0 is stored as 1. Each 64 bit word holds a
+	// 4^3 brick in Z-order and the bricks are laid out linearly, padded out to a multiple
+	// of 4 on each axis. Indexes are bit indexes into the words
+	Occupancy
+};
+
 class ArrayMap {
 	
 
 public:
 
-	ArrayMap(Vector3i dimensions);
+	// Starts out with every voxel 0
+	ArrayMap(Vector3i dimensions, VoxelLayout layout = VoxelLayout::Linear);
 	~ArrayMap();
 
+	// Sets about half the voxels to a material from 1 to 3 and clears the rest. Drawn by
+	// position from a counter based stream, so a seed gives the same map in any layout
+	void fillRandom(uint64_t seed);
+
+	// Replaces every voxel with rolling hills of layered stone (1), dirt (2) and grass (3).
+	// Rays through random noise only ever travel a voxel or two, so this is the scene the
+	// benchmarks and the headless renderer trace through
+	void fillTerrain();
+
 	char getVoxel(Vector3i position);
 	void setVoxel(Vector3i position, char value);
 	Vector3i getDimensions();
+	VoxelLayout getLayout();
+
+	// Whether the voxel at position is set, in any layout
+	bool testVoxel(Vector3i position);
+
+	// Occupancy layout only, the word holding the 4^3 brick that position is in. Bit
+	// MortonEncode(x & 3, y & 3, z & 3) is the voxel at (x, y, z)
+	uint64_t getWord(Vector3i position);
+	void setWord(Vector3i position, uint64_t word);
+
+	// Offset of the voxel at position in getDataPtr()
+	uint64_t getIndex(Vector3i position);
+
+	// Offset of the voxel at position in voxel data of the given layout and dimensions. All
+	// indexing into dense voxel data goes through here
+	static uint64_t getIndex(VoxelLayout layout, Vector3i dimensions, Vector3i position);
+
+	// Bytes of voxel data, which is more than the voxel count for the padded layouts
+	static uint64_t getSize(VoxelLayout layout, Vector3i dimensions);
+
+	// Frees the voxel data once it has been handed off to something else, getDataPtr()
+	// returns nullptr afterwards
+	void release();
 
 	// =========== DEBUG =========== //
 	char* getDataPtr();
@@ -24,5 +77,33 @@ private:
 
 	char *voxel_data;
 	Vector3i dimensions;
+	VoxelLayout layout;
 	
 };
+
+// Inlined as every voxel read while generating and validating goes through it
+inline uint64_t ArrayMap::getIndex(VoxelLayout layout, Vector3i dimensions, Vector3i position) {
+
+	switch (layout) {
+
+	case VoxelLayout::Morton:
+		return MortonEncode(position.x, position.y, position.z);
+
+	case VoxelLayout::Bricked: {
+		uint64_t bricks_x = (dimensions.x + 7) >> 3;
+		uint64_t bricks_y = (dimensions.y + 7) >> 3;
+		uint64_t brick = (position.x >> 3) + bricks_x * ((position.y >> 3) + bricks_y * (position.z >> 3));
+		return (brick << 9) | (position.x & 7) | ((position.y & 7) << 3) | ((position.z & 7) << 6);
+	}
+
+	case VoxelLayout::Occupancy: {
+		uint64_t bricks_x = (dimensions.x + 3) >> 2;
+		uint64_t bricks_y = (dimensions.y + 3) >> 2;
+		uint64_t brick = (position.x >> 2) + bricks_x * ((position.y >> 2) + bricks_y * (position.z >> 2));
+		return (brick << 6) | MortonEncode(position.x & 3, position.y & 3, position.z & 3);
+	}
+
+	default:
+		return position.x + (uint64_t)dimensions.x * (position.y + (uint64_t)dimensions.y * position.z);
+	}
+}
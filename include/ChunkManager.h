@@ -0,0 +1,137 @@
+#pragma once
+#include <condition_variable>
+#include <deque>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "Map.h"
+
+// Counters for tuning the memory budget
+struct ChunkManagerStats {
+
+	size_t resident_chunks = 0;
+	uint64_t resident_bytes = 0;
+
+	// Chunks waiting for a worker, and chunks a worker is building or has built that update
+	// hasn't handed to the map yet
+	size_t queued = 0;
+	size_t in_flight = 0;
+
+	// Evicted chunks a worker hasn't finished writing out yet
+	size_t saving = 0;
+
+	uint64_t generated = 0;
+	uint64_t loaded = 0;
+	uint64_t evicted = 0;
+	uint64_t evicted_bytes = 0;
+
+	// Chunks that came out empty, which take no memory
+	uint64_t empty = 0;
+
+	// Chunk files that couldn't be read. The chunk stays on disk and is tried again a few
+	// times before it's left there
+	uint64_t load_failures = 0;
+};
+
+// Keeps the chunks of a Map around a set of focus positions resident. Missing chunks are read
+// back from disk or generated from the map's terrain on a pool of worker threads, and when the
+// resident chunks go over the memory budget the least recently used ones outside of the focus
+// are dropped from the map and saved to disk by the workers. Everything but the workers runs
+// on the thread that owns the map, in update
+class ChunkManager {
+
+public:
+
+	// Chunks within radius chunks of a focus position are kept resident. Evicted chunks are
+	// saved to file_prefix followed by their chunk coordinates. 0 threads uses one per
+	// hardware thread
+	ChunkManager(Map* map, std::string file_prefix, uint64_t memory_budget, int radius = 4, unsigned int thread_count = 0);
+	~ChunkManager();
+
+	ChunkManager(const ChunkManager&) = delete;
+	ChunkManager& operator=(const ChunkManager&) = delete;
+
+	// World positions, usually where the players are
+	void setFocus(const std::vector<Vector3i>& positions);
+
+	// Hands the chunks the workers have finished over to the map, queues the chunks around
+	// the focus that aren't resident nearest first, then evicts until the budget is met.
+	// Edits made through the map are picked up here too, but have to be made to resident
+	// chunks as an edit to a chunk on disk starts a new chunk
+	void update();
+
+	// Calls update until nothing is queued, in flight or being saved
+	void flush();
+
+	// Moves the chunk to the front of the eviction order, for chunks used outside of the focus
+	void touch(Vector3i chunk);
+
+	// Deletes the files of the evicted chunks, the ones not resident will be generated again
+	// if they're needed. This is also how a chunk whose file couldn't be read is given up on
+	void clearDisk();
+
+	ChunkManagerStats getStats();
+
+private:
+
+	enum class ChunkState { Queued, Resident, Empty, Saving, OnDisk };
+
+	struct ChunkJob {
+		Vector3i chunk;
+		bool from_disk;
+		uint64_t voxel_count;
+	};
+
+	std::string chunkFileName(Vector3i chunk);
+
+	// Drops the chunk from the map and hands it to the workers to save
+	void evict(Vector3i chunk);
+
+	// Written next to the old file and moved over it, false if it couldn't be
+	bool save(Vector3i chunk, MapChunk* map_chunk);
+
+	void worker();
+
+	Map* map;
+	std::string file_prefix;
+	uint64_t memory_budget;
+	int radius;
+
+	// Chunk coordinates of the focus positions
+	std::vector<Vector3i> focus;
+
+	// Every chunk the manager has seen, chunks it hasn't have never been generated
+	std::unordered_map<Vector3i, ChunkState, XYZHasher> states;
+
+	// Voxel counts of the chunks on disk, which the octree files don't carry
+	std::unordered_map<Vector3i, uint64_t, XYZHasher> disk_voxel_counts;
+
+	// Failed reads of each chunk on disk, which isn't queued again once it reaches the limit
+	static const int max_load_attempts = 3;
+	std::unordered_map<Vector3i, int, XYZHasher> load_failures;
+
+	// Resident chunks, most recently used first, and where each one is in the list
+	std::list<Vector3i> lru;
+	std::unordered_map<Vector3i, std::list<Vector3i>::iterator, XYZHasher> lru_position;
+
+	// Shared with the workers
+	std::mutex mutex;
+	std::condition_variable job_ready;
+	std::deque<ChunkJob> jobs;
+	std::vector<std::pair<Vector3i, std::unique_ptr<MapChunk>>> finished;
+	std::vector<Vector3i> unreadable;
+
+	// Evicted chunks waiting to be written, which go ahead of the jobs, and the ones written
+	std::deque<std::pair<Vector3i, std::unique_ptr<MapChunk>>> saves;
+	std::vector<Vector3i> saved;
+	size_t saving = 0;
+	size_t building = 0;
+	bool stopping = false;
+	std::vector<std::thread> workers;
+
+	ChunkManagerStats counters;
+};
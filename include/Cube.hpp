@@ -33,6 +33,8 @@
 ////////////////////////////////////////////////////////////
 #include "Vector3.hpp"
 #include <algorithm>
+#include <cmath>
+#include <cstdlib>
 
 
 ////////////////////////////////////////////////////////////
@@ -131,6 +133,21 @@ public:
     ////////////////////////////////////////////////////////////
     bool contains(const Vector3<T>& point) const;
 
+    ////////////////////////////////////////////////////////////
+    /// \brief Check if another Cube lies entirely inside the Cube
+    ///
+    /// A Cube that shares an edge with this one still counts as
+    /// inside, an empty Cube is never inside.
+    ///
+    /// \param cube Cube to test
+    ///
+    /// \return True if \a cube is inside, false otherwise
+    ///
+    /// \see intersects
+    ///
+    ////////////////////////////////////////////////////////////
+    bool contains(const Cube<T>& cube) const;
+
     ////////////////////////////////////////////////////////////
     /// \brief Check the intersection between two Cubes
     ///
@@ -262,8 +279,8 @@ bool Cube<T>::contains(T x, T y, T z) const
     T maxX = std::max(left, static_cast<T>(left + width));
     T minY = std::min(top, static_cast<T>(top + height));
     T maxY = std::max(top, static_cast<T>(top + height));
-    T minZ = std::min(top, static_cast<T>(front + depth));
-    T maxZ = std::max(top, static_cast<T>(front + depth));
+    T minZ = std::min(front, static_cast<T>(front + depth));
+    T maxZ = std::max(front, static_cast<T>(front + depth));
 
     return (x >= minX) && (x < maxX) && (y >= minY) && (y < maxY) && (z >= minZ) && (z < maxZ);
 }
@@ -274,6 +291,19 @@ bool Cube<T>::contains(const Vector3<T>& point) const
     return contains(point.x, point.y, point.z);
 }
 
+template <typename T>
+bool Cube<T>::contains(const Cube<T>& cube) const
+{
+    // The intersection of the two is the whole of the other Cube only if it's inside
+    Cube<T> intersection;
+    if (!intersects(cube, intersection))
+        return false;
+
+    return intersection.width == std::abs(cube.width) &&
+           intersection.height == std::abs(cube.height) &&
+           intersection.depth == std::abs(cube.depth);
+}
+
 template <typename T>
 bool Cube<T>::intersects(const Cube<T>& cube) const
 {
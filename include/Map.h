@@ -2,7 +2,9 @@
 #include <functional>
 #include <bitset>
 #include <ctime>
+#include <memory>
 #include <queue>
+#include <unordered_map>
 #include "ArrayMap.h"
 #include "Logger.h"
 #include "Octree.h"
@@ -11,21 +13,85 @@
 #define _USE_MATH_DEFINES
 #include <cmath>
 
+// Hashes XYZ chunk coordinates for the chunk table
+struct XYZHasher {
+	std::size_t operator()(const Vector3i& k) const {
+		return ((std::hash<int>()(k.x)
+			^ (std::hash<int>()(k.y) << 1)) >> 1)
+			^ (std::hash<int>()(k.z) << 1);
+	}
+};
+
+// A chunk of the world with its own octree, and how many of its voxels are set so it can
+// be dropped once it's empty
+struct MapChunk {
+	Octree octree;
+	uint64_t voxel_count = 0;
+};
+
 class Map {
 public: 
 
-	// Currently takes a 
-	Map(uint32_t dimensions);
+	// The world is split into chunk_dimensions^3 chunks which only exist once something is
+	// set in them, so it has no bounds and costs memory in proportion to what's in it.
+	// chunk_dimensions has to be a power of 2. The cube from (0, 0, 0) to dimensions is
+	// filled with terrain from seed, 0 starts the world empty
+	Map(uint32_t dimensions, uint32_t chunk_dimensions = 32, uint64_t seed = 0);
+
+	// Replaces the cube from (0, 0, 0) to dimensions with terrain: a diamond-square height
+	// map of stone (1), dirt (2) and grass (3), with caves cut out of it by 3D noise if caves
+	// is set. Slabs of chunks are generated on thread_count threads, 0 uses one per hardware
+	// thread. The same seed gives the same terrain whatever the thread count
+	void generateTerrain(uint32_t dimensions, uint64_t seed, bool caves = true, unsigned int thread_count = 0);
 
-	// Sets a voxel in the 3D char dataset
+	// Sets up the terrain generateTerrain and generateChunk work from without generating any
+	// of it. The world is dimensions high from y = 0 and its height map repeats every
+	// dimensions, rounded up to a power of 2, along x and z
+	void setTerrain(uint32_t dimensions, uint64_t seed, bool caves = true, unsigned int thread_count = 0);
+
+	// Generates and validates the chunk from the terrain without adding it to the map, nullptr
+	// if it's empty. It only reads the map so it can be called from several threads at once,
+	// as long as nothing calls setTerrain meanwhile
+	std::unique_ptr<MapChunk> generateChunk(Vector3i chunk);
+
+	// Sets a voxel anywhere in the world, making or dropping its chunk as needed
 	void setVoxel(Vector3i position, int val);
 	
-	// Gets a voxel at the 3D position in the octree
+	// Bulk edits anywhere in the world, see the ones on Octree. Chunks the shape reaches are
+	// made as needed and dropped if it leaves them empty
+	void fillCube(IntCube cube, char value);
+	void fillSphere(Vector3f center, float radius, char value);
+
+	// Gets a voxel anywhere in the world, 0 where there's no chunk
 	char getVoxel(Vector3i pos);
 
-	// Octree handles all basic octree operations
-    Octree octree;
-	ArrayMap array_map;
+	// Region queries in world coordinates, see the ones on Octree. Chunks that don't exist are
+	// skipped and a chunk wholly inside the region is answered from its voxel count
+	uint64_t countOccupied(IntCube region);
+	bool anyOccupied(IntCube region);
+	std::vector<OccupiedRegion> findOccupied(IntCube region);
+	std::vector<Vector3i> findOccupiedVoxels(IntCube region);
+
+	// The chunk with the given chunk coordinates, nullptr if it's empty. Its octree covers
+	// chunk * getChunkDimensions() up to the next chunk
+	MapChunk* getChunk(Vector3i chunk);
+
+	// Chunk coordinates of the chunk that position is in, and where position is inside of it
+	Vector3i getChunkPosition(Vector3i position);
+	Vector3i getLocalPosition(Vector3i position);
+
+	// Compacts every chunk's octree, collapsing what edits left uniform and dropping the
+	// nodes they replaced
+	void compact();
+
+	uint32_t getChunkDimensions();
+	size_t getChunkCount();
+
+	// Bytes held by the chunk octrees and the chunk table
+	uint64_t getMemoryUsage();
+
+	// Every chunk in the world by its chunk coordinates
+	std::unordered_map<Vector3i, std::unique_ptr<MapChunk>, XYZHasher> chunks;
 
 private:
 
@@ -36,18 +102,63 @@ private:
 	Vector3i dimensions;
 	// =========================
 
+	uint32_t chunk_dimensions;
+
+	// log2 of chunk_dimensions, chunk coordinates are position >> chunk_shift
+	int chunk_shift;
+
+	// Calls visit with every chunk that overlaps region, the chunks origin, the part of the
+	// region inside the chunk in the chunks own coordinates and whether that's all of the
+	// chunk, stopping when visit returns false
+	template <typename Visit>
+	void regionChunks(IntCube region, Visit visit);
+
+	// Adds a chunk with nothing in it to be edited
+	std::unordered_map<Vector3i, std::unique_ptr<MapChunk>, XYZHasher>::iterator addEmptyChunk(Vector3i chunk);
+
+	// Applies a bulk edit to every chunk that overlaps bounds. fill gets the chunk's octree and
+	// the chunk's origin and returns the change in set voxels, touches whether the shape reaches
+	// into the chunk at all
+	template <typename Fill, typename Touches>
+	void fillChunks(IntCube bounds, char value, Fill fill, Touches touches);
+
+	// Generates and validates a chunk from the voxels in array_map, nullptr if it's empty
+	std::unique_ptr<MapChunk> buildChunk(ArrayMap* array_map);
+
+	// Fills array_map with the terrain in the chunk, leaving anything at or past bounds and
+	// below y = 0 empty
+	void fillChunk(Vector3i chunk, Vector3i bounds, ArrayMap* array_map);
+
+	// What setTerrain was last called with
+	uint32_t terrain_dimensions = 0;
+	uint64_t terrain_seed = 0;
+	bool terrain_caves = false;
+
+	// The height map the terrain works from, height_map_size on a side and wrapping at the
+	// edges, with heights from 0 to 1
+	std::vector<double> height_map;
+	int height_map_size = 0;
+
+	// Diamond-square over the height map, each pass split by rows over thread_count threads
+	void generateHeightMap(uint32_t dimensions, uint64_t seed, unsigned int thread_count);
+
+	// The corners of the value noise lattice around a chunk for each of the three octaves,
+	// so the caves hash each corner once a chunk instead of once a voxel
+	struct NoiseLattice {
+		Vector3i base[3];
+		int size[3];
+		std::vector<double> values[3];
+	};
+
+	void buildNoiseLattice(uint64_t seed, Vector3i origin, NoiseLattice* lattice);
+
+	// Three octaves of value noise from 0 to 1 with periods of 32, 16 and 8, for the caves.
+	// The position has to be inside the chunk the lattice was built for
+	double Noise(NoiseLattice* lattice, int x, int y, int z);
+
 	double Sample(int x, int y, double *height_map);
 	void SetSample(int x, int y, double value, double *height_map);
 	void SampleSquare(int x, int y, int size, double value, double *height_map);
 	void SampleDiamond(int x, int y, int size, double value, double *height_map);
 
 };
-
-// Might possibly use this struct for hashing XYZ chunk values into a dict for storage and loading
-struct XYZHasher {
-	std::size_t operator()(const Vector3i& k) const {
-		return ((std::hash<int>()(k.x)
-			^ (std::hash<int>()(k.y) << 1)) >> 1)
-			^ (std::hash<int>()(k.z) << 1);
-	}
-};
@@ -0,0 +1,39 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "Vector3.hpp"
+
+// Quads over the exposed faces of voxels, as triangles. Every quad has 4 vertices of its own
+// sharing its face normal, so indices holds 6 entries and values 1 per quad
+struct Mesh {
+
+	std::vector<Vector3f> vertices;
+	std::vector<Vector3f> normals;
+	std::vector<uint32_t> indices;
+
+	// Value of the voxels under each quad
+	std::vector<char> values;
+
+	size_t quadCount() const;
+	size_t triangleCount() const;
+
+	// Adds the quads of another mesh after these
+	void append(const Mesh &mesh);
+
+	// Greedy meshes the inner part of a block of voxels laid out like ArrayMap, which has a
+	// border a voxel thick all the way around for the neighbours of the voxels along its
+	// edges. A face is exposed when the voxel is set and its neighbour isn't, and exposed
+	// faces of the same value in a slice are merged into as few rectangles as the sweep finds.
+	// origin is where the first inner voxel goes in the mesh
+	void addVoxels(const char* data, Vector3i dimensions, Vector3i origin);
+
+	// Wavefront OBJ with a usemtl for each run of quads with the same value, named value_N
+	bool saveObj(std::string file_name) const;
+
+private:
+
+	// The rectangle from u, v to u + width, v + height in the slice at depth along axis, facing
+	// down the axis when direction is negative
+	void addQuad(int axis, int direction, int depth, int u, int v, int width, int height, Vector3i origin, char value);
+};
@@ -1,6 +1,13 @@
 #pragma once
+#include <memory>
 #include <tuple>
+#include <unordered_map>
 #include <vector>
+#include "ArrayMap.h"
+#include "PageCache.h"
+#include "Cube.hpp"
+#include "Mesh.h"
+#include "PagedBuffer.hpp"
 #include "util.hpp"
 #include "Vector3.hpp"
 
@@ -18,61 +25,363 @@ struct OctState {
 
 	Vector3i oct_pos;
 
+	// Value of the voxel, 0 if it's empty. A query stopped early by a level of detail gets
+	// the representative value of the node it stopped at
+	char value = 0;
+
+	// Fraction of the voxels under the node the query stopped at that are set, 1 for a set
+	// voxel or a solid leaf
+	float coverage = 0;
+
 	// ====== DEBUG =======
 	char found = 1;
 };
 
+// Result of a ray cast, voxel, distance and normal are only filled out on a hit
+struct RayHit {
+
+	bool hit = false;
+	Vector3i voxel;
+	float distance = 0;
+	char value = 0;
+
+	// Normal of the face the ray came in through, 0 if the ray started inside the voxel
+	Vector3i normal;
+
+	// Fraction of the node that was hit that's set, only under 1 when a level of detail cutoff
+	// stopped the ray at a node that isn't solid
+	float coverage = 0;
+};
+
+// A voxel the octree disagrees with the data about
+struct VoxelMismatch {
+
+	Vector3i position;
+	char expected;
+	char found;
+};
+
+// A uniform piece of the occupied part of a region, a leaf of the tree clipped to the region
+struct OccupiedRegion {
+
+	IntCube cube;
+	char value;
+};
+
+// Voxels connected to each other across their faces, found by Octree::ConnectedComponents
+struct ConnectedComponent {
+
+	IntCube bounds;
+	uint64_t voxels = 0;
+};
+
+// The components of a tree numbered in the order the tree is walked, along with every uniform
+// cube the tree is made of that was labelled and the component it's in
+struct ComponentLabels {
+
+	std::vector<ConnectedComponent> components;
+	std::vector<IntCube> cubes;
+	std::vector<uint32_t> labels;
+};
+
+// What Octree::Validate found
+struct ValidationReport {
+
+	uint64_t voxels = 0;			// voxels compared
+	uint64_t mismatch_count = 0;
+
+	// The first few mismatches, in the order the tree was walked
+	std::vector<VoxelMismatch> mismatches;
+
+	bool valid() const {
+		return mismatch_count == 0;
+	}
+};
+
+// Counters for what it cost to build a tree
+struct OctreeBuildStats {
+
+	uint64_t nodes = 0;				// descriptors written, including the root
+	uint64_t far_pointers = 0;
+	uint64_t page_headers = 0;
+	uint64_t shared_blocks = 0;		// child blocks pointed at instead of written again
+	unsigned int max_depth = 0;		// deepest the generator recursed
+
+	void Add(const OctreeBuildStats& other) {
+		nodes += other.nodes;
+		far_pointers += other.far_pointers;
+		page_headers += other.page_headers;
+		shared_blocks += other.shared_blocks;
+		max_depth = std::max(max_depth, other.max_depth);
+	}
+};
+
+// Header of a saved octree, see Octree::Save
+struct OctreeFileHeader;
+
+// A generated node on its way up to its parent: its descriptor, the absolute position of its
+// child block, and the values of its valid leaf children packed a byte per child
+typedef std::tuple<uint64_t, uint64_t, uint64_t> GeneratedNode;
+
+// Everything that goes into a child block apart from where it's written, two blocks with the
+// same key hold identical subtrees
+struct ChildBlockKey {
+
+	int size = 0;
+	GeneratedNode children[8];
+
+	bool operator==(const ChildBlockKey &other) const {
+		return size == other.size && std::equal(children, children + size, other.children);
+	}
+};
+
+struct ChildBlockHasher {
+	std::size_t operator()(const ChildBlockKey& k) const {
+		uint64_t hash = k.size;
+		for (int i = 0; i < k.size; i++) {
+			hash = (hash ^ std::get<0>(k.children[i])) * 0x100000001B3;
+			hash = (hash ^ std::get<1>(k.children[i])) * 0x100000001B3;
+			hash = (hash ^ std::get<2>(k.children[i])) * 0x100000001B3;
+		}
+		return (std::size_t)(hash ^ (hash >> 32));
+	}
+};
+
+// A run of descriptors laid out in generation order. When the octree is built in parallel each
+// top level subtree is generated into its own segment, which are then stitched together
+struct DescriptorSegment {
+
+	PagedBuffer<uint64_t> descriptors;
+
+	// Positions of the far pointers in this segment. They hold absolute positions so they
+	// need to be rebased when the segment is stitched into another
+	PagedBuffer<uint64_t> far_pointers;
+
+	// Packed leaf values for the descriptor at the same position, see GeneratedNode
+	PagedBuffer<uint64_t> leaf_values;
+
+	// Slots left in the current page. Starting at 0 makes the first write open a page
+	int page_header_counter = 0;
+
+	// Edits write descriptors with their values already in the edit attachments
+	bool collect_leaf_values = true;
+
+	// When deduplicating, every child block written so far and where it went. A block that's
+	// already been written is pointed at again instead
+	bool deduplicate = false;
+	std::unordered_map<ChildBlockKey, uint64_t, ChildBlockHasher> written_blocks;
+
+	OctreeBuildStats stats;
+};
+
 
 class Octree {
 public:
 
-	static const int buffer_size = 100000;
+	// Descriptor pages line up with the pages of the storage buffers
+	static const int page_size = PagedBuffer<uint64_t>::page_size;
 
 	Octree();
-	~Octree() {};
+	~Octree();
+
+	// Generate an octree from 3D indexed array of char data. The top 8 (or 64) subtrees are
+	// built concurrently on thread_count threads, 0 uses one thread per hardware thread
+	void Generate(char* data, Vector3i dimensions, unsigned int thread_count = 0, VoxelLayout layout = VoxelLayout::Linear);
+
+	// Generate from the map's data in whatever layout it was built with
+	void Generate(ArrayMap* array_map, unsigned int thread_count = 0);
+
+	// What the last call to Generate cost
+	OctreeBuildStats build_stats;
+
+	// Writes the tree out in the binary format below, edits and all
+	bool Save(std::string octree_file_name);
+
+	// Maps a file written by Save and uses its pages in place, nothing is copied or parsed.
+	// The mapping is private so edits to a loaded tree never make it back to the file. On
+	// failure the current tree is left as it was
+	bool Load(std::string octree_file_name);
+
+	// The file is a header followed by the descriptor, attachment lookup, attachment, edit
+	// attachment and level of detail buffers. Each buffer starts on a file_alignment boundary
+	// and is written as whole pages, so once the file is mapped the pages can be borrowed
+	// straight from it
+	static const uint32_t file_version = 3;
+	static const uint64_t file_alignment = 4096;
 
-	// Generate an octree from 3D indexed array of char data
-	void Generate(char* data, Vector3i dimensions);
+	// Serves the tree straight out of a file written by Save, keeping at most cache_pages
+	// descriptor pages in memory and reading the rest in as traversals reach them. The
+	// attachments are read in whole. The tree is read only until something else replaces it
+	bool Stream(std::string octree_file_name, uint64_t cache_pages);
 
-	// TODO: Load the octree from a serialized or whatever file
-	void Load(std::string octree_file_name);
+	// The descriptor pages of a streamed tree, null otherwise
+	std::unique_ptr<PageCache> page_cache;
 	
+	// Every descriptor page has a section in the attachment buffer, found through attachment_lookup,
+	// holding a palette of the voxel values used in the page followed by packed palette indices
+	// for the valid leafs. A descriptors contour pointer is the index of its first leaf value
+	//
 	// I think the best way to transfer all of the data to the GPU. Each buffer will contain a set of blocks
 	// except for the trunk buffer. The paper indicates that the cutoff point for the trunk can vary,
 	// but since I'm going to do seperate buffers, I'm going to set a hard cutoff for the trunk so we
 	// know when to switch buffers
 
-	uint64_t *descriptor_buffer;
-	uint64_t descriptor_buffer_position = buffer_size - 1;
-
-	uint32_t *attachment_lookup;
-	uint64_t attachment_lookup_position = buffer_size - 1;
-
-	uint64_t *attachment_buffer;
-	uint64_t attachment_buffer_position = buffer_size - 1;
+	// Descriptors are written in generation order from the front of the buffer. Children
+	// always come before their parents so child pointers are relative offsets backwards.
+	// The buffers grow a page at a time as they're written, so they only hold as many
+	// pages as the tree needs
+	PagedBuffer<uint64_t> descriptor_buffer;
+	PagedBuffer<uint32_t> attachment_lookup;
+	PagedBuffer<uint64_t> attachment_buffer;
+
+	// Descriptors written by edits don't fit into a pages palette, their contour pointer has the
+	// contour_edit_bit set and indexes a word here holding the values of all 8 children
+	PagedBuffer<uint64_t> edit_attachment_buffer;
+
+	// Level of detail. Each descriptors contour mask holds how much of its node is set in
+	// 255ths, and the entry here at the same position holds the nodes representative value,
+	// the most common value of its children weighted by their coverage. Generate and Compact
+	// fill it in and edits keep the path they change up to date
+	PagedBuffer<uint8_t> lod_buffer;
+
+	// Distance bounds. The entry at a descriptors position holds a byte for each of its children,
+	// for an empty child a lower bound in voxels on the distance from anywhere in it to the
+	// nearest set voxel, up to 255, and 0 for the rest. Empty until BuildDistanceBounds runs.
+	// Edits that set voxels, Compact and Deduplicate drop them, while carving keeps them as they
+	// stay lower bounds. Descriptors written past the end of it by later edits count as 0
+	PagedBuffer<uint64_t> distance_buffer;
 
 	unsigned int trunk_cutoff = 3;
 	uint64_t root_index = 0;
 
-	int page_header_counter = 0x8000;
+	// Bumped by everything that changes the tree, so an OctreeCursor can tell its path is stale
+	uint64_t revision = 0;
 
 	// Cheat and underflow to get the position
 	uint64_t current_info_section_position = ((uint64_t)0)-1;
 	
-
-	uint64_t stack_pos = 0x8000;
-	uint64_t global_pos = buffer_size - 50;
-	
 	// With a position and the head of the stack. Traverse down the voxel hierarchy to find
-	// the IDX and stack position of the highest resolution (maybe set resolution?) oct
-	OctState GetVoxel(Vector3i position);
+	// the IDX and stack position of the highest resolution oct, or stop at the node max_depth
+	// levels below the root and answer with its representative value and coverage
+	OctState GetVoxel(Vector3i position, unsigned int max_depth = 32);
+
+	// Looks up a batch of positions, writing the value of each one into results in the
+	// same order. The queries are walked in Morton order and each one restarts from the
+	// deepest ancestor it shares with the previous query instead of from the root
+	void GetVoxels(const Vector3i* positions, size_t count, char* results);
+
+	// Walks the descriptors along the ray and returns the first occupied voxel within
+	// max_distance. Follows the push / pop / advance traversal from the ESVO paper. With a
+	// lod_factor the ray stops at the first node smaller than lod_factor times its distance
+	// and hits it as a whole, the angle a pixel covers stops it at nodes about a pixel across
+	RayHit CastRay(Vector3f origin, Vector3f direction, float max_distance, float lod_factor = 0);
+
+	// Exact Euclidean distance from the center of every voxel in region to the center of the
+	// nearest set voxel in region, 0 for set voxels and infinity if the region has none. Set
+	// voxels outside of the region don't count. distances is laid out like ArrayMap with the
+	// width, height and depth of the region as its dimensions. The region is decoded and run
+	// through the separable squared distance transform from Felzenszwalb & Huttenlocher, a
+	// pass along each axis with the lines of each pass split across thread_count threads
+	void DistanceField(IntCube region, float* distances, unsigned int thread_count = 0);
+
+	// Fills in distance_buffer by searching the tree for the set voxel nearest to every empty
+	// child, with the nodes split across thread_count threads
+	void BuildDistanceBounds(unsigned int thread_count = 0);
+
+	// Lower bound in voxels on the distance from the voxel at position to the nearest set voxel,
+	// from the distance bound of the empty node it's in. 0 for a set voxel, outside of the tree,
+	// or when there are no distance bounds
+	float Clearance(Vector3i position);
+
+	// Region queries. Subtrees outside of the region are skipped and leafs of any size are
+	// taken whole, so a query costs in proportion to the nodes the region touches rather than
+	// its volume. AnyOccupied stops at the first occupied leaf it finds, or at the first subtree
+	// inside the region with any coverage. CountOccupied takes solid subtrees inside the region
+	// whole, but coverage is only in 255ths so a partly set subtree is still walked down to its
+	// leafs. Counting those would need an exact count kept per node
+	uint64_t CountOccupied(IntCube region);
+	bool AnyOccupied(IntCube region);
+
+	// The occupied part of the region as uniform cubes, in the order the tree is walked
+	std::vector<OccupiedRegion> FindOccupied(IntCube region);
+
+	// Every occupied voxel in the region, in the order the tree is walked
+	std::vector<Vector3i> FindOccupiedVoxels(IntCube region);
+
+	// Labels the face connected components of the set voxels, or with empty of the empty voxels
+	// inside the tree. Uniform cubes of any size are labelled whole and the cubes sharing a face
+	// are found by following the faces between the children of every node down to the cubes on
+	// either side, so it costs in proportion to the node count rather than the volume. Subtrees
+	// are labelled on thread_count threads, each in its own part of the union find, and joined
+	// across the faces between them after. An empty component whose bounds don't reach the edge
+	// of the tree is an enclosed cavity, a set one that doesn't reach down to y = 0 is floating
+	ComponentLabels ConnectedComponents(bool empty = false, unsigned int thread_count = 0);
+
+	// Sets the voxel at position to value. A voxel in a leaf level node is changed in place,
+	// otherwise the path from the root down to the voxel is copied into free space at the end
+	// of the buffer and the old path is left behind until the next Compact
+	void SetVoxel(Vector3i position, char value);
+
+	// Old paths are garbage that only Compact reclaims. Once the descriptor buffer has grown to
+	// auto_compact_growth times the size the last Generate, Load or Compact left it at, SetVoxel
+	// and the fills Compact before they edit, so the garbage stays in proportion to the tree.
+	// 0 leaves compacting to the caller
+	float auto_compact_growth = 8;
+
+	// Bulk edits, value 0 carves. Every voxel inside the cube, or with its center inside the
+	// sphere, is set to value. Nodes the shape covers whole become uniform leafs, so only the
+	// nodes along its surface are rebuilt, copied to the end of the buffer like SetVoxel's path.
+	// Returns how many more voxels are set than before, an edit that doesn't fit into the edit
+	// attachments even after a Compact logs an error and leaves the tree as it was
+	int64_t FillCube(IntCube cube, char value);
+	int64_t FillSphere(Vector3f center, float radius, char value);
+
+	// Rewrites the part of the buffer that's still reachable from the root in generation order,
+	// dropping what edits left behind and collapsing nodes they made uniform. A deduplicated
+	// tree stays deduplicated
+	void Compact();
+
+	// Rewrites the tree sharing a single copy of every distinct subtree, making it a DAG. Parents
+	// point at the shared child blocks through the usual child and far pointers so everything
+	// that reads the tree works as before. Edits to a DAG always copy the path they change
+	void Deduplicate();
+
+	// Set once the tree has been deduplicated, until it's next generated
+	bool deduplicated = false;
 
 	void print_block(int block_pos);
 
-    bool Validate(char* data, Vector3i dimensions);
+	// Expands the tree into data, which is laid out like ArrayMap and getDimensions() on a side.
+	// The top of the tree is split up across thread_count threads, 0 uses one thread per
+	// hardware thread
+	void Decode(char* data, unsigned int thread_count = 0);
+
+	// Expands the part of the tree inside region into data, which is laid out like ArrayMap with
+	// the width, height and depth of the region as its dimensions. Anything in the region that's
+	// outside of the tree is left as it is
+	void Decode(IntCube region, char* data, unsigned int thread_count = 0);
+
+	// Greedy meshes the exposed faces of the set voxels in region. Faces on the edge of the
+	// region are only exposed when the voxel outside of it is empty, so neighbouring regions
+	// mesh without faces between them. The region is cut into chunks chunk_size on a side and a
+	// chunk the tree has nothing in, or that's solid out to the voxels around it, is skipped
+	// without being decoded. The rest are decoded and meshed on thread_count threads and their
+	// meshes put together in chunk order
+	Mesh ExtractMesh(IntCube region, unsigned int thread_count = 0, unsigned int chunk_size = 32);
+
+	// Walks the tree once comparing every leaf against the region of the data it covers, with
+	// the top of the tree split up across thread_count threads, 0 uses one thread per hardware
+	// thread. Reports at most max_reported of the mismatches it finds
+	ValidationReport Validate(char* data, Vector3i dimensions, unsigned int thread_count = 0, size_t max_reported = 16, VoxelLayout layout = VoxelLayout::Linear);
+
+	// Validate against the map's data in whatever layout it was built with
+	ValidationReport Validate(ArrayMap* array_map, unsigned int thread_count = 0, size_t max_reported = 16);
 
 	unsigned int getDimensions();
 
+	// Bytes held by the descriptor, attachment, level of detail and distance bound buffers
+	uint64_t MemoryUsage();
+
 	// (X, Y, Z) mask for the idx
 	static const uint8_t idx_set_x_mask = 0x1;
 	static const uint8_t idx_set_y_mask = 0x2;
@@ -91,20 +400,256 @@ public:
 	static const uint64_t valid_mask = 0xFF0000;
 	static const uint64_t leaf_mask = 0xFF000000;
 	static const uint64_t contour_pointer_mask = 0xFFFFFF00000000;
-	static const uint64_t contour_mask = 0xFF00000000000000;
+	static const uint64_t contour_mask = 0xFF00000000000000;		// coverage, see lod_buffer
+	static const uint64_t contour_edit_bit = 0x80000000000000;
 
 private:
 
+	friend class OctreeCursor;
+
 	unsigned int oct_dimensions = 1;
 
-	std::tuple<uint64_t, uint64_t> GenerationRecursion(
+	// Slots left in the last page of the descriptor buffer, edits write into it
+	int page_header_counter = 0;
+
+	// The file the buffers are borrowing their pages from, if the tree was loaded
+	void* mapped_file = nullptr;
+	uint64_t mapped_file_size = 0;
+
+	// Unmaps the loaded file, once nothing is borrowing from it anymore
+	void UnmapFile();
+
+	// Sanity checks a file header against the size of the file it came from
+	static bool ValidFileHeader(const OctreeFileHeader &header, uint64_t file_size);
+
+	// Reads the descriptor at index out of the buffer, or the page cache when streaming
+	uint64_t Descriptor(uint64_t index) {
+		return page_cache ? page_cache->read(index) : descriptor_buffer[index];
+	}
+
+	GeneratedNode GenerationRecursion(
 		char* data,					// raw octree data
 		Vector3i dimensions,	// dimensions of the raw data
+		VoxelLayout layout,		// how the raw data is laid out
 		Vector3i pos,			// position of this generation node
-		unsigned int voxel_scale	// the voxel scale of this node
-	); 
+		unsigned int voxel_scale,	// the voxel scale of this node
+		unsigned int depth,			// how many levels below the root this node is
+		DescriptorSegment* segment	// segment the child descriptors are written to
+	);
+
+	// Generates the levels above the parallel split, picking up the already built subtrees
+	// once it reaches them
+	GeneratedNode TrunkRecursion(
+		Vector3i pos,
+		unsigned int voxel_scale,
+		unsigned int split_level,
+		std::vector<GeneratedNode>* subtrees,
+		DescriptorSegment* segment
+	);
+
+	// Sets the masks for the i'th child in the parents descriptor, and queues the child
+	// up for the parents child block if it needs a descriptor of its own
+	void AttachChild(
+		int i,
+		GeneratedNode child,
+		GeneratedNode* parent,
+		GeneratedNode* child_block,
+		int* child_block_size
+	);
+
+	// Writes a block of child descriptors along with any far pointers they need and returns
+	// the position of the first child in the block
+	uint64_t WriteChildBlock(DescriptorSegment* segment, GeneratedNode* child_block, int child_block_size);
+
+	// Appends a segment onto the front of a new page in the trunk, rebasing its far pointers
+	// and the position of the subtree that was generated into it
+	void StitchSegment(DescriptorSegment* trunk, DescriptorSegment* segment, GeneratedNode* subtree);
+
+	// True if any of the descriptors children are valid non-leafs, i.e. it has a child block
+	static bool HasChildBlock(uint64_t descriptor);
+
+	// True if all 8 packed leaf values are the same
+	static bool IsUniform(uint64_t leaf_values);
+
+	// Packs the leaf values of every descriptor into its pages section of the attachment buffer
+	// and points the descriptors contour pointer at them. Each page gets a palette of the values
+	// it uses and the leafs store indices into it, packed as tightly as the palette allows
+	void BuildAttachments(PagedBuffer<uint64_t>* leaf_values);
+
+	// Value of the idx'th child of the descriptor at index, which has to be a valid leaf
+	char LeafValue(uint64_t index, uint64_t descriptor, int idx);
+
 	
-	char get1DIndexedVoxel(char* data, Vector3i dimensions, Vector3i position);
+	// Continues a traversal toward position from the node at state->scale, which has to be
+	// on the path to it, stopping at max_depth. GetVoxel starts this from the root
+	void Traverse(OctState* state, Vector3i position, unsigned int max_depth = 32);
+
+	// Position of the idx'th child of the descriptor at parent_index, following its far pointer if it has one
+	uint64_t ChildIndex(uint64_t parent_index, uint64_t descriptor, int idx);
+
+	// Position of the first child in the descriptors child block
+	uint64_t ChildBlockPosition(uint64_t parent_index, uint64_t descriptor);
+
+	// Values of all 8 children of the descriptor at index packed a byte per child, 0 for
+	// anything that isn't a valid leaf
+	uint64_t LeafValues(uint64_t index, uint64_t descriptor);
+
+	// Fills in the coverage and representative value of every node, children first. A shared
+	// node is only done once
+	void BuildLevelOfDetail();
+	void LevelOfDetailRecursion(uint64_t index, std::vector<bool>* done);
+
+	// Works out the coverage and representative value of the descriptor at index from its
+	// children, which have to be up to date
+	void SetLevelOfDetail(uint64_t index);
+
+	// Brings the nodes on a path edited in place back up to date, deepest first
+	void UpdateLevelOfDetail(const OctState &path);
+
+	// For a node an edit just built from children, fills in the values of its child block and
+	// sets its coverage. child_values holds the representative values of the children that
+	// aren't leafs, the nodes own goes into child_values[8]
+	void EditLevelOfDetail(GeneratedNode* node, GeneratedNode* children, uint8_t* child_values);
+
+	// Sets the coverage in the descriptor from its leaf values and its other childrens coverage
+	// and values, and returns its representative value
+	template <typename ChildCoverage>
+	uint8_t CombineLevelOfDetail(uint64_t* descriptor, uint64_t leaf_values, ChildCoverage child_coverage, const uint8_t* child_values);
+
+	// Rewrites the tree into a fresh buffer, for Compact and Deduplicate
+	void Rebuild(bool deduplicate);
+
+	// Regenerates the subtree under the descriptor at index into segment. When the tree is a
+	// DAG, rebuilt remembers the subtrees that have been done so shared ones are only done once
+	GeneratedNode CompactRecursion(
+		uint64_t index,
+		uint64_t descriptor,
+		DescriptorSegment* segment,
+		std::unordered_map<uint64_t, GeneratedNode>* rebuilt
+	);
+
+	// Fills children with a GeneratedNode for each child of the descriptor at index, which can
+	// be handed back to AttachChild to build a copy of it somewhere else, and child_values with
+	// the representative values of the ones that aren't leafs
+	void CopyChildren(uint64_t index, uint64_t descriptor, GeneratedNode* children, uint8_t* child_values = nullptr);
+
+	// Squared distance from cube to the nearest set voxel under the descriptor, which covers
+	// the cube at pos and size, or best if nothing is nearer. Children nearest the cube are
+	// searched first so best shrinks quickly
+	float NearestOccupied(const IntCube &cube, uint64_t index, uint64_t descriptor, Vector3i pos, unsigned int size, float best);
+
+	// Distance bound of the idx'th child of the descriptor at index
+	uint8_t DistanceBound(uint64_t index, int idx);
+
+	// The tree expanded out for ConnectedComponents, a cell for every node and every child of a
+	// node. The children of a node are in 8 consecutive cells
+	struct ComponentCell {
+
+		// 0 for a uniform cell, as the root is cell 0 nothing else can start there
+		uint32_t first_child;
+
+		// Index of the cell in the labelled cubes, or no_cube if it isn't being labelled
+		uint32_t cube;
+	};
+
+	static const uint32_t no_cube = 0xFFFFFFFF;
+
+	void ComponentCellBuild(bool empty, uint64_t index, uint64_t descriptor, Vector3i pos, unsigned int size, uint32_t cell, std::vector<ComponentCell>* cells, std::vector<IntCube>* cubes);
+
+	// Joins the cubes across every face inside the cell, stopping at stop_depth where other
+	// threads have the cells below
+	void ComponentCellRecursion(const std::vector<ComponentCell> &cells, std::vector<uint32_t>* parents, uint32_t cell, unsigned int depth, unsigned int stop_depth);
+
+	// Joins the cubes on either side of the face between two neighbouring cells, low being
+	// below high along axis
+	void ComponentFaceRecursion(const std::vector<ComponentCell> &cells, std::vector<uint32_t>* parents, uint32_t low, uint32_t high, int axis);
+
+	// Attaches the 8 children to a new node and writes its child block into segment
+	GeneratedNode EditNode(GeneratedNode* children, DescriptorSegment* segment);
+
+	// What a bulk edit fills, a cube or a sphere
+	struct EditShape {
+		bool sphere;
+		IntCube cube;
+		Vector3f center;
+		float radius;
+	};
+
+	// -1 if the shape misses every voxel of the node at pos, 1 if it covers all of them and 0
+	// if it's somewhere in between. A single voxel is never in between
+	static int ClassifyShape(const EditShape &shape, Vector3i pos, unsigned int size);
+
+	int64_t FillShape(const EditShape &shape, char value);
+
+	// Rebuilds the node at pos with the shape filled in, descending only into the children the
+	// shape partly covers. The node is either the descriptor at index or, without one, a leaf
+	// of old_value being split up. node_value gets its representative value and set_voxels
+	// the change in the number of set voxels under it added on
+	GeneratedNode FillRecursion(
+		const EditShape &shape,
+		char value,
+		bool has_descriptor,
+		uint64_t index,
+		uint64_t descriptor,
+		char old_value,
+		Vector3i pos,
+		unsigned int size,
+		DescriptorSegment* segment,
+		uint8_t* node_value,
+		int64_t* set_voxels
+	);
+
+	// Points the descriptor at a word in the edit attachments holding its values, reusing
+	// the one it already has. When the contour pointer can't index another word it sets
+	// edit_attachments_full instead, and the edit running has to be backed out
+	void AssignEditAttachment(GeneratedNode* node);
+	bool edit_attachments_full = false;
+
+	// Compacts once the buffer has grown past auto_compact_growth times compacted_size, the
+	// size it had after the last Generate, Load or Compact
+	void CompactIfGrown();
+	uint64_t compacted_size = 0;
+
+	char get1DIndexedVoxel(char* data, Vector3i dimensions, VoxelLayout layout, Vector3i position);
+
+	// The 8 voxels of the 2^3 block at pos packed into a word by child idx, pos has to be even
+	uint64_t GetVoxelBlock(char* data, Vector3i dimensions, VoxelLayout layout, Vector3i pos);
+
+	// A piece of the tree for a worker thread, either the subtree under a descriptor or a
+	// region covered by a leaf of the given value
+	struct TreeTask {
+		uint64_t index;
+		uint64_t descriptor;
+		Vector3i pos;
+		unsigned int size;
+		bool region;
+		char value;
+	};
+
+	// Breaks the part of the tree inside region up into at least task_count pieces, where the
+	// tree allows it
+	std::vector<TreeTask> SplitTree(IntCube region, unsigned int task_count);
+
+	void ValidationRecursion(char* data, Vector3i dimensions, VoxelLayout layout, uint64_t index, uint64_t descriptor, Vector3i pos, unsigned int size, size_t max_reported, ValidationReport* report);
+
+	void DecodeRecursion(IntCube region, char* data, uint64_t index, uint64_t descriptor, Vector3i pos, unsigned int size);
+
+	// Calls visit with the part of every valid leaf under the descriptor that's inside region
+	// and the leafs value, stopping as soon as visit returns false. False if it was stopped.
+	// A subtree wholly inside the region whose coverage is at least whole_coverage is visited
+	// as one cube with its representative value instead of being walked, so 255 takes solid
+	// subtrees whole, 1 any subtree with something in it and 256 never prunes
+	template <typename Visit>
+	bool RegionRecursion(IntCube region, uint64_t index, uint64_t descriptor, Vector3i pos, unsigned int size, Visit &visit, unsigned int whole_coverage = 256);
+
+	// Set voxels in the subtree under the descriptor at index, which covers size voxels from pos
+	uint64_t SubtreeOccupied(uint64_t index, Vector3i pos, unsigned int size);
+
+	// Writes value to the part of cube that's inside region, data covers the region
+	void FillRegion(IntCube region, char* data, IntCube cube, char value);
+
+	// Compares a region of the data against a single value
+	void ValidateRegion(char* data, Vector3i dimensions, VoxelLayout layout, Vector3i pos, unsigned int size, char value, size_t max_reported, ValidationReport* report);
 
 	std::vector<uint64_t> anchor_stack;
 	unsigned int octree_voxel_dimension = 32;
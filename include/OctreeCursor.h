@@ -0,0 +1,49 @@
+#pragma once
+#include "Octree.h"
+
+// A lookup into an Octree that stays where it was left. Moving it somewhere else only pops
+// back up to the deepest node the old and new positions share and descends again from there,
+// so small steps cost a level or two instead of a walk down from the root. Anything that
+// changes the tree bumps its revision and the next move starts over from the root
+class OctreeCursor {
+
+public:
+
+	// Starts out at position. Like GetVoxel, max_depth stops the lookups that many levels
+	// below the root with the representative value of the node they stopped at
+	OctreeCursor(Octree* octree, Vector3i position = Vector3i(0, 0, 0), unsigned int max_depth = 32);
+
+	// Moves to position and returns the value there, 0 outside of the tree
+	char MoveTo(Vector3i position);
+
+	// Moves by offset from the current position, a single step is Move(Vector3i(1, 0, 0))
+	char Move(Vector3i offset);
+
+	char Value() const;
+	Vector3i Position() const;
+
+	// The traversal state of the last lookup inside the tree, its scale is the level the
+	// lookup stopped at
+	const OctState& State() const;
+
+private:
+
+	Octree* octree;
+	OctState state;
+
+	Vector3i position;
+	unsigned int max_depth;
+
+	// Where state was last traversed to, which is position unless position is outside
+	Vector3i traversed;
+	bool outside = false;
+
+	// Levels below the root the tree has, and its revision when state was filled out
+	unsigned int levels = 0;
+	uint64_t revision = 0;
+
+	// False when state doesn't hold a path into the current tree, the next move starts over
+	bool valid = false;
+
+	void Restart();
+};
@@ -0,0 +1,88 @@
+#pragma once
+#include <cstdint>
+#include <fstream>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "PagedBuffer.hpp"
+
+// Counters for how well the cache is doing
+struct PageCacheStats {
+
+	uint64_t hits = 0;
+	uint64_t misses = 0;
+	uint64_t evictions = 0;
+};
+
+// Holds up to capacity pages of a buffer that lives in a file, reading them in when they're
+// first touched and evicting the least recently used page when it's full. Pages are laid out
+// back to back in the file in the same shape PagedBuffer keeps them in memory. The pages are
+// split over shards by page number, each with its own lock, file and share of the capacity,
+// so threads reading different pages don't wait on each other. Eviction is least recently
+// used within a shard
+class PageCache {
+
+public:
+
+	static const uint64_t page_size = PagedBuffer<uint64_t>::page_size;
+	static const uint64_t max_shards = 16;
+	static const uint64_t min_shard_pages = 8;
+
+	// The buffer starts offset bytes into the file and holds count entries
+	PageCache(std::string file_name, uint64_t offset, uint64_t count, uint64_t capacity);
+	~PageCache();
+
+	PageCache(const PageCache&) = delete;
+	PageCache& operator=(const PageCache&) = delete;
+
+	bool is_open() const;
+
+	uint64_t read(uint64_t index);
+
+	uint64_t size() const;
+	uint64_t capacity() const;
+
+	PageCacheStats stats();
+	void reset_stats();
+
+	// Bytes held by the resident pages
+	uint64_t memory_usage();
+
+private:
+
+	// Holds the pages whose number modulo the shard count is its own. Shard pages are
+	// numbered page / shard count
+	struct Shard {
+
+		std::ifstream file;
+		uint64_t max_pages;
+
+		// Page data for the slots, allocated as the shard fills up
+		std::vector<uint64_t*> slots;
+
+		// Slot for each of the shards pages, -1 if it's not resident
+		std::vector<int64_t> page_slot;
+
+		// Resident pages, most recently used first, and where each one is in the list
+		std::list<uint64_t> lru;
+		std::vector<std::list<uint64_t>::iterator> lru_position;
+
+		// The last page that was read, which skips the lookup on runs of reads within a page
+		uint64_t last_page = (uint64_t)-1;
+		uint64_t* last_data = nullptr;
+
+		PageCacheStats counters;
+		std::mutex mutex;
+	};
+
+	// Slot the page is resident in, reading it in first if it isn't. The shard has to be locked
+	uint64_t* fault(Shard* shard, uint64_t page);
+
+	uint64_t offset;
+	uint64_t count;
+	uint64_t max_pages;
+
+	std::vector<std::unique_ptr<Shard>> shards;
+};
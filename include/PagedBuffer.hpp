@@ -0,0 +1,204 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+// A buffer that grows on demand one fixed size page at a time. Pages never move once
+// they are allocated, so growing the buffer never copies what's already been written.
+// The page size matches the octrees descriptor pages so one storage page holds exactly
+// one page of descriptors along with its header. The first page starts out small and
+// doubles up to a full page, it's the only page that ever moves and only while it's the only
+// page, so a small buffer doesn't cost a whole page
+template <typename T>
+class PagedBuffer {
+public:
+
+	static const uint64_t page_size = 0x8000;
+	static const uint64_t first_page_size = 64;
+
+	PagedBuffer() {};
+	~PagedBuffer() { clear(); };
+
+	PagedBuffer(const PagedBuffer&) = delete;
+	PagedBuffer& operator=(const PagedBuffer&) = delete;
+
+	PagedBuffer(PagedBuffer&& other) {
+		std::swap(pages, other.pages);
+		std::swap(count, other.count);
+		std::swap(borrowed_pages, other.borrowed_pages);
+		std::swap(first_page_entries, other.first_page_entries);
+	}
+
+	PagedBuffer& operator=(PagedBuffer&& other) {
+		clear();
+		std::swap(pages, other.pages);
+		std::swap(count, other.count);
+		std::swap(borrowed_pages, other.borrowed_pages);
+		std::swap(first_page_entries, other.first_page_entries);
+		return *this;
+	}
+
+	T& operator[](uint64_t i) {
+		return pages[i / page_size][i % page_size];
+	}
+
+	const T& operator[](uint64_t i) const {
+		return pages[i / page_size][i % page_size];
+	}
+
+	void push_back(const T& value) {
+		if (count == capacity())
+			grow(count + 1);
+		pages[count / page_size][count % page_size] = value;
+		count++;
+	}
+
+	// Grows with zeroed entries, shrinking zeroes the dropped entries but keeps their
+	// pages around until trim() is called
+	void resize(uint64_t new_size) {
+
+		grow(new_size);
+
+		for (uint64_t i = new_size; i < count; i++)
+			(*this)[i] = T();
+
+		count = new_size;
+	}
+
+	// Takes over all the pages of another buffer, which has to start on a page boundary
+	// of this one and can't have borrowed pages. The other buffer is left empty
+	void append_pages(PagedBuffer&& other) {
+
+		trim();
+
+		// Everything but the last page has to be whole, as does the other buffers first page
+		if (!pages.empty())
+			fill_first_page();
+		if (!other.pages.empty())
+			other.fill_first_page();
+		if (pages.empty())
+			first_page_entries = other.first_page_entries;
+
+		pages.insert(pages.end(), other.pages.begin(), other.pages.end());
+		count = count + other.count;
+
+		other.pages.clear();
+		other.count = 0;
+		other.first_page_entries = 0;
+	}
+
+	// Hand back the pages past the end of the buffer along with any slack in the page table
+	void trim() {
+
+		uint64_t used_pages = (count + page_size - 1) / page_size;
+
+		for (uint64_t i = std::max(used_pages, borrowed_pages); i < pages.size(); i++)
+			delete[] pages[i];
+
+		pages.resize(used_pages);
+		borrowed_pages = std::min(borrowed_pages, used_pages);
+		pages.shrink_to_fit();
+
+		if (pages.empty())
+			first_page_entries = 0;
+	}
+
+	void clear() {
+
+		for (uint64_t i = borrowed_pages; i < pages.size(); i++)
+			delete[] pages[i];
+
+		pages.clear();
+		count = 0;
+		borrowed_pages = 0;
+		first_page_entries = 0;
+	}
+
+	// Replaces the contents with count entries of memory the buffer doesn't own, which has to
+	// be laid out as whole pages. Those pages are never freed by the buffer and writing to them
+	// writes to the memory, pages added past them are owned as usual
+	void borrow(T* data, uint64_t count) {
+
+		clear();
+
+		for (uint64_t i = 0; i < count; i += page_size)
+			pages.push_back(data + i);
+
+		this->count = count;
+		borrowed_pages = pages.size();
+		first_page_entries = pages.empty() ? 0 : page_size;
+	}
+
+	uint64_t size() const {
+		return count;
+	}
+
+	uint64_t page_count() const {
+		return pages.size();
+	}
+
+	T* page(uint64_t i) {
+		return pages[i];
+	}
+
+	// Entries allocated for page i, which is less than page_size for a small first page
+	uint64_t page_entries(uint64_t i) const {
+		return i == 0 ? first_page_entries : page_size;
+	}
+
+	// Bytes held by the pages and the page table
+	uint64_t memory_usage() const {
+		return capacity() * sizeof(T) + pages.capacity() * sizeof(T*);
+	}
+
+private:
+
+	uint64_t capacity() const {
+		return pages.empty() ? 0 : first_page_entries + (pages.size() - 1) * page_size;
+	}
+
+	// Makes room for at least new_size entries
+	void grow(uint64_t new_size) {
+
+		while (capacity() < new_size) {
+
+			if (pages.empty()) {
+				first_page_entries = std::min((uint64_t)page_size, std::max((uint64_t)first_page_size, new_size));
+				pages.push_back(new T[first_page_entries]());
+			}
+			else if (first_page_entries < page_size) {
+				resize_first_page(std::min((uint64_t)page_size, std::max(first_page_entries * 2, new_size)));
+			}
+			else {
+				pages.push_back(new T[page_size]());
+			}
+		}
+	}
+
+	void fill_first_page() {
+		if (first_page_entries < page_size)
+			resize_first_page(page_size);
+	}
+
+	// Only ever called while the first page is the only one, and it can't be borrowed as
+	// borrowed pages are always whole
+	void resize_first_page(uint64_t entries) {
+
+		T* page = new T[entries]();
+		std::copy(pages[0], pages[0] + std::min(count, first_page_entries), page);
+		delete[] pages[0];
+
+		pages[0] = page;
+		first_page_entries = entries;
+	}
+
+	std::vector<T*> pages;
+	uint64_t count = 0;
+
+	// The first borrowed_pages pages belong to someone else
+	uint64_t borrowed_pages = 0;
+
+	// Entries allocated for the first page
+	uint64_t first_page_entries = 0;
+};
@@ -0,0 +1,50 @@
+#pragma once
+#include <string>
+#include <vector>
+#include "Octree.h"
+#include "Vector3.hpp"
+
+// Timing for a single frame
+struct FrameStats {
+
+	double seconds = 0;
+	double rays_per_second = 0;
+
+	// How long each tile took, in the order the tiles are laid out
+	std::vector<double> tile_seconds;
+};
+
+// Renders an octree on the CPU without a window or GPU. The frame is split into tiles which
+// a pool of worker threads pull from, casting one primary ray per pixel
+class Renderer {
+
+public:
+
+	Renderer(Octree* octree, int width, int height);
+
+	void SetCamera(Vector3f position, Vector3f target, float fov_degrees);
+
+	FrameStats RenderFrame(unsigned int thread_count = 0);
+
+	// Writes the last frame out as a binary PPM
+	bool WritePPM(std::string file_name);
+
+	int tile_size = 16;
+
+private:
+
+	void RenderTile(int tile_x, int tile_y);
+
+	Octree* octree;
+	int width;
+	int height;
+
+	// RGB, 3 bytes a pixel, rows top to bottom
+	std::vector<uint8_t> pixels;
+
+	Vector3f camera_position;
+	Vector3f camera_forward;
+	Vector3f camera_right;
+	Vector3f camera_up;
+	float fov_scale = 1;
+};
@@ -53,6 +53,7 @@ inline void DumpLog(std::stringstream* ss, std::string file_name) {
 #  include <intrin.h>
 #  define __builtin_popcount _mm_popcnt_u32
 #  define __builtin_popcountll _mm_popcnt_u64
+#  define __builtin_clzll __lzcnt64
 #endif
 
 inline int count_bits(int32_t v) {
@@ -63,6 +64,59 @@ inline int count_bits(int64_t v) {
 	return static_cast<int>(__builtin_popcountll(v));
 }
 
+// Index of the highest set bit, v can't be 0
+inline int HighestBit(uint64_t v) {
+	return 63 - __builtin_clzll(v);
+}
+
+// Spreads the low 21 bits of v out so there are two 0 bits between each of them
+inline uint64_t MortonSpread(uint64_t v) {
+	v &= 0x1FFFFF;
+	v = (v | v << 32) & 0x1F00000000FFFF;
+	v = (v | v << 16) & 0x1F0000FF0000FF;
+	v = (v | v << 8)  & 0x100F00F00F00F00F;
+	v = (v | v << 4)  & 0x10C30C30C30C30C3;
+	v = (v | v << 2)  & 0x1249249249249249;
+	return v;
+}
+
+// Inverse of MortonSpread, gathers every third bit back down into the low 21 bits
+inline uint32_t MortonCompact(uint64_t v) {
+	v &= 0x1249249249249249;
+	v = (v | v >> 2)  & 0x10C30C30C30C30C3;
+	v = (v | v >> 4)  & 0x100F00F00F00F00F;
+	v = (v | v >> 8)  & 0x1F0000FF0000FF;
+	v = (v | v >> 16) & 0x1F00000000FFFF;
+	v = (v | v >> 32) & 0x1FFFFF;
+	return (uint32_t)v;
+}
+
+// Interleaves the coordinates with x in the lowest bit, the same order the octree
+// numbers its children in
+inline uint64_t MortonEncode(uint32_t x, uint32_t y, uint32_t z) {
+	return MortonSpread(x) | (MortonSpread(y) << 1) | (MortonSpread(z) << 2);
+}
+
+// Counter based random numbers, the splitmix64 finalizer over the seed and counter. The same
+// seed and counter always give the same number, so anything drawing from it can be generated
+// in any order on any number of threads
+inline uint64_t HashRandom(uint64_t seed, uint64_t counter) {
+	uint64_t z = seed + (counter + 1) * 0x9E3779B97F4A7C15;
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EB;
+	return z ^ (z >> 31);
+}
+
+// By position, which repeats every 2^21 voxels along each axis
+inline uint64_t HashRandom(uint64_t seed, int x, int y, int z) {
+	return HashRandom(seed, (uint64_t)(x & 0x1FFFFF) | ((uint64_t)(y & 0x1FFFFF) << 21) | ((uint64_t)(z & 0x1FFFFF) << 42));
+}
+
+// Uniform in [0, 1)
+inline double HashRandomUnit(uint64_t seed, int x, int y, int z) {
+	return (HashRandom(seed, x, y, z) >> 11) * (1.0 / 9007199254740992.0);
+}
+
 inline void SetBit(int position, char* c) {
 	*c |= (uint64_t)1 << position;
 }
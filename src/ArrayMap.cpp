@@ -1,26 +1,49 @@
+#include <cmath>
+#include <cstring>
 #include <ArrayMap.h>
 
-ArrayMap::ArrayMap(Vector3i dimensions) {
+ArrayMap::ArrayMap(Vector3i dimensions, VoxelLayout layout) {
 	
 	this->dimensions = dimensions;
-	voxel_data = new char[dimensions.x * dimensions.y * dimensions.z];
+	this->layout = layout;
 
-	// Init to 0
-	for (int i = 0; i < dimensions.x * dimensions.y * dimensions.z; i++) {
-		voxel_data[i] = 0;
+	// Init to 0, which also covers the padding
+	uint64_t size = getSize(layout, dimensions);
+	voxel_data = new char[size];
+	std::fill(voxel_data, voxel_data + size, 0);
+}
+
+void ArrayMap::fillRandom(uint64_t seed) {
+
+	for (int z = 0; z < dimensions.z; z++) {
+		for (int y = 0; y < dimensions.y; y++) {
+			for (int x = 0; x < dimensions.x; x++) {
+
+				// Low bit picks set or not, the next ones the material
+				uint64_t random = HashRandom(seed, x, y, z);
+				setVoxel(Vector3i(x, y, z), (random & 1) ? 1 + (char)((random >> 1) % 3) : 0);
+			}
+		}
 	}
+}
 
+void ArrayMap::fillTerrain() {
 
-	// Randomly set data
-    srand(time(nullptr));
 	for (int x = 0; x < dimensions.x; x++) {
-		for (int y = 0; y < dimensions.y; y++) {
-			for (int z = 0; z < dimensions.z; z++) {
+		for (int z = 0; z < dimensions.z; z++) {
+
+			double height = dimensions.y * (0.4 + 0.1 * std::sin(x * 0.05) + 0.1 * std::cos(z * 0.07) + 0.05 * std::sin((x + z) * 0.21));
 
-                if (rand() % 2 == 0)
-                    setVoxel(Vector3i(x, y, z), 1);
-                else
-                    setVoxel(Vector3i(x, y, z), 0);
+			// Stone with a few voxels of dirt on top and a grass surface
+			for (int y = 0; y < dimensions.y; y++) {
+				char material = 0;
+				if (y < height - 4)
+					material = 1;
+				else if (y < height - 1)
+					material = 2;
+				else if (y < height)
+					material = 3;
+				setVoxel(Vector3i(x, y, z), material);
 			}
 		}
 	}
@@ -32,18 +55,79 @@ ArrayMap::~ArrayMap() {
 }
 
 char ArrayMap::getVoxel(Vector3i position) {
-	return voxel_data[position.x + dimensions.x * (position.y + dimensions.z * position.z)];
+
+	if (layout == VoxelLayout::Occupancy)
+		return (char)((getWord(position) >> (getIndex(position) & 63)) & 1);
+
+	return voxel_data[getIndex(layout, dimensions, position)];
 }
 
 
 void ArrayMap::setVoxel(Vector3i position, char value) {
-	voxel_data[position.x + dimensions.x * (position.y + dimensions.z * position.z)] = value;
+
+	if (layout == VoxelLayout::Occupancy) {
+		uint64_t bit = (uint64_t)1 << (getIndex(position) & 63);
+		uint64_t word = getWord(position);
+		setWord(position, value ? word | bit : word & ~bit);
+		return;
+	}
+
+	voxel_data[getIndex(layout, dimensions, position)] = value;
+}
+
+bool ArrayMap::testVoxel(Vector3i position) {
+	return getVoxel(position) != 0;
+}
+
+uint64_t ArrayMap::getWord(Vector3i position) {
+	uint64_t word;
+	std::memcpy(&word, voxel_data + (getIndex(position) >> 6) * sizeof(word), sizeof(word));
+	return word;
+}
+
+void ArrayMap::setWord(Vector3i position, uint64_t word) {
+	std::memcpy(voxel_data + (getIndex(position) >> 6) * sizeof(word), &word, sizeof(word));
 }
 
 Vector3i ArrayMap::getDimensions() {
 	return dimensions;
 }
 
+VoxelLayout ArrayMap::getLayout() {
+	return layout;
+}
+
+uint64_t ArrayMap::getIndex(Vector3i position) {
+	return getIndex(layout, dimensions, position);
+}
+
+uint64_t ArrayMap::getSize(VoxelLayout layout, Vector3i dimensions) {
+
+	switch (layout) {
+
+	case VoxelLayout::Morton: {
+		uint64_t side = 1;
+		while (side < (uint64_t)std::max(dimensions.x, std::max(dimensions.y, dimensions.z)))
+			side <<= 1;
+		return side * side * side;
+	}
+
+	case VoxelLayout::Bricked:
+		return (uint64_t)((dimensions.x + 7) & ~7) * ((dimensions.y + 7) & ~7) * ((dimensions.z + 7) & ~7);
+
+	case VoxelLayout::Occupancy:
+		return (uint64_t)((dimensions.x + 3) >> 2) * ((dimensions.y + 3) >> 2) * ((dimensions.z + 3) >> 2) * sizeof(uint64_t);
+
+	default:
+		return (uint64_t)dimensions.x * dimensions.y * dimensions.z;
+	}
+}
+
+void ArrayMap::release() {
+	delete[] voxel_data;
+	voxel_data = nullptr;
+}
+
 char* ArrayMap::getDataPtr() {
 	return voxel_data;
-}
\ No newline at end of file
+}
@@ -0,0 +1,353 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include "ChunkManager.h"
+
+ChunkManager::ChunkManager(Map* map, std::string file_prefix, uint64_t memory_budget, int radius, unsigned int thread_count) :
+	map(map), file_prefix(file_prefix), memory_budget(memory_budget), radius(radius) {
+
+	if (thread_count == 0)
+		thread_count = std::max(1u, std::thread::hardware_concurrency());
+
+	for (unsigned int i = 0; i < thread_count; i++)
+		workers.emplace_back(&ChunkManager::worker, this);
+}
+
+ChunkManager::~ChunkManager() {
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+		jobs.clear();
+	}
+
+	job_ready.notify_all();
+	for (std::thread &t : workers)
+		t.join();
+}
+
+void ChunkManager::setFocus(const std::vector<Vector3i>& positions) {
+
+	focus.clear();
+	for (const Vector3i &position : positions)
+		focus.push_back(map->getChunkPosition(position));
+}
+
+void ChunkManager::update() {
+
+	std::vector<std::pair<Vector3i, std::unique_ptr<MapChunk>>> done;
+	std::vector<Vector3i> written;
+	std::vector<Vector3i> failed;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		done.swap(finished);
+		written.swap(saved);
+		failed.swap(unreadable);
+	}
+
+	for (const Vector3i &chunk : written)
+		states[chunk] = ChunkState::OnDisk;
+
+	// The file is still the only copy of the chunk, so it's left on disk to be tried again
+	for (const Vector3i &chunk : failed) {
+		states[chunk] = ChunkState::OnDisk;
+		load_failures[chunk]++;
+	}
+
+	for (auto &chunk : done) {
+
+		// An edit may have started the chunk while it was being built or saved, the edit wins.
+		// Chunks that couldn't be saved come back this way too
+		if (chunk.second && !map->getChunk(chunk.first))
+			map->chunks[chunk.first] = std::move(chunk.second);
+		else if (!chunk.second)
+			counters.empty++;
+
+		states[chunk.first] = map->getChunk(chunk.first) ? ChunkState::Resident : ChunkState::Empty;
+		load_failures.erase(chunk.first);
+	}
+
+	// New chunks, whether a worker or an edit made them, and chunks edits emptied
+	for (auto &chunk : map->chunks) {
+		if (!lru_position.count(chunk.first)) {
+			states[chunk.first] = ChunkState::Resident;
+			lru.push_front(chunk.first);
+			lru_position[chunk.first] = lru.begin();
+		}
+	}
+
+	for (auto chunk = lru.begin(); chunk != lru.end();) {
+		if (map->getChunk(*chunk)) {
+			++chunk;
+			continue;
+		}
+		states[*chunk] = ChunkState::Empty;
+		lru_position.erase(*chunk);
+		chunk = lru.erase(chunk);
+	}
+
+	// Everything in range of the focus is touched, and anything missing queued up. Wanted
+	// holds how far each chunk is from the nearest focus
+	std::unordered_map<Vector3i, int, XYZHasher> wanted;
+	std::vector<ChunkJob> new_jobs;
+
+	for (const Vector3i &center : focus) {
+		for (int z = -radius; z <= radius; z++) {
+			for (int y = -radius; y <= radius; y++) {
+				for (int x = -radius; x <= radius; x++) {
+
+					int distance = x * x + y * y + z * z;
+					if (distance > radius * radius)
+						continue;
+
+					Vector3i chunk = center + Vector3i(x, y, z);
+
+					auto seen = wanted.find(chunk);
+					if (seen != wanted.end()) {
+						seen->second = std::min(seen->second, distance);
+						continue;
+					}
+					wanted[chunk] = distance;
+
+					auto state = states.find(chunk);
+
+					if (state == states.end()) {
+						new_jobs.push_back(ChunkJob{ chunk, false, 0 });
+						states[chunk] = ChunkState::Queued;
+					}
+					else if (state->second == ChunkState::OnDisk) {
+
+						auto failures = load_failures.find(chunk);
+						if (failures != load_failures.end() && failures->second >= max_load_attempts)
+							continue;
+
+						new_jobs.push_back(ChunkJob{ chunk, true, disk_voxel_counts[chunk] });
+						state->second = ChunkState::Queued;
+					}
+					else if (state->second == ChunkState::Resident) {
+						touch(chunk);
+					}
+				}
+			}
+		}
+	}
+
+	// Jobs the focus has moved away from are dropped and the rest go nearest first, new or not
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+
+		std::vector<ChunkJob> queue;
+		for (const ChunkJob &job : jobs) {
+
+			if (wanted.count(job.chunk)) {
+				queue.push_back(job);
+				continue;
+			}
+
+			if (job.from_disk)
+				states[job.chunk] = ChunkState::OnDisk;
+			else
+				states.erase(job.chunk);
+		}
+
+		queue.insert(queue.end(), new_jobs.begin(), new_jobs.end());
+		std::stable_sort(queue.begin(), queue.end(), [&wanted](const ChunkJob &a, const ChunkJob &b) {
+			return wanted[a.chunk] < wanted[b.chunk];
+		});
+
+		jobs.assign(queue.begin(), queue.end());
+	}
+
+	if (!new_jobs.empty())
+		job_ready.notify_all();
+
+	// Oldest first, skipping whatever the focus still needs
+	uint64_t resident_bytes = 0;
+	for (const Vector3i &chunk : lru)
+		resident_bytes += map->getChunk(chunk)->octree.MemoryUsage();
+
+	std::vector<Vector3i> candidates;
+	for (auto chunk = lru.rbegin(); chunk != lru.rend() && resident_bytes > memory_budget; ++chunk)
+		if (!wanted.count(*chunk))
+			candidates.push_back(*chunk);
+
+	for (const Vector3i &chunk : candidates) {
+
+		if (resident_bytes <= memory_budget)
+			break;
+
+		uint64_t bytes = map->getChunk(chunk)->octree.MemoryUsage();
+		evict(chunk);
+
+		resident_bytes -= bytes;
+		counters.evicted_bytes += bytes;
+	}
+
+	counters.resident_chunks = lru.size();
+	counters.resident_bytes = resident_bytes;
+}
+
+void ChunkManager::flush() {
+
+	while (true) {
+
+		update();
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if (jobs.empty() && building == 0 && finished.empty() && unreadable.empty() && saves.empty() && saving == 0 && saved.empty())
+				return;
+		}
+
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+}
+
+void ChunkManager::touch(Vector3i chunk) {
+
+	auto position = lru_position.find(chunk);
+	if (position == lru_position.end())
+		return;
+
+	lru.splice(lru.begin(), lru, position->second);
+}
+
+void ChunkManager::clearDisk() {
+
+	// Chunks still being written keep their files
+	for (auto chunk = disk_voxel_counts.begin(); chunk != disk_voxel_counts.end();) {
+
+		auto state = states.find(chunk->first);
+		if (state != states.end() && state->second == ChunkState::Saving) {
+			++chunk;
+			continue;
+		}
+
+		std::remove(chunkFileName(chunk->first).c_str());
+		if (state != states.end() && state->second == ChunkState::OnDisk)
+			states.erase(state);
+
+		load_failures.erase(chunk->first);
+
+		chunk = disk_voxel_counts.erase(chunk);
+	}
+}
+
+ChunkManagerStats ChunkManager::getStats() {
+
+	std::lock_guard<std::mutex> lock(mutex);
+
+	ChunkManagerStats stats = counters;
+	stats.queued = jobs.size();
+	stats.in_flight = building + finished.size();
+	stats.saving = saves.size() + saving;
+
+	return stats;
+}
+
+std::string ChunkManager::chunkFileName(Vector3i chunk) {
+	return file_prefix + std::to_string(chunk.x) + "_" + std::to_string(chunk.y) + "_" + std::to_string(chunk.z) + ".oct";
+}
+
+void ChunkManager::evict(Vector3i chunk) {
+
+	auto map_chunk = map->chunks.find(chunk);
+
+	disk_voxel_counts[chunk] = map_chunk->second->voxel_count;
+	states[chunk] = ChunkState::Saving;
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		saves.push_back(std::make_pair(chunk, std::move(map_chunk->second)));
+	}
+	job_ready.notify_one();
+
+	lru.erase(lru_position[chunk]);
+	lru_position.erase(chunk);
+	map->chunks.erase(map_chunk);
+}
+
+bool ChunkManager::save(Vector3i chunk, MapChunk* map_chunk) {
+
+	// A chunk that was read back in and never compacted is still mapped from the old file
+	std::string file_name = chunkFileName(chunk);
+	if (!map_chunk->octree.Save(file_name + ".tmp") || std::rename((file_name + ".tmp").c_str(), file_name.c_str()) != 0) {
+		Logger::log("Could not evict chunk to " + file_name, Logger::LogLevel::ERROR, __LINE__, __FILE__);
+		return false;
+	}
+
+	return true;
+}
+
+void ChunkManager::worker() {
+
+	while (true) {
+
+		ChunkJob job{};
+		std::pair<Vector3i, std::unique_ptr<MapChunk>> eviction;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			job_ready.wait(lock, [this]() { return stopping || !jobs.empty() || !saves.empty(); });
+
+			// Evicted chunks only exist in the save queue, so they're written out even when stopping
+			if (!saves.empty()) {
+				eviction = std::move(saves.front());
+				saves.pop_front();
+				saving++;
+			}
+			else if (stopping) {
+				return;
+			}
+			else {
+				job = jobs.front();
+				jobs.pop_front();
+				building++;
+			}
+		}
+
+		if (eviction.second) {
+
+			bool written = save(eviction.first, eviction.second.get());
+
+			std::lock_guard<std::mutex> lock(mutex);
+			saving--;
+			if (written) {
+				saved.push_back(eviction.first);
+				counters.evicted++;
+			}
+			else {
+				finished.push_back(std::move(eviction));
+			}
+			continue;
+		}
+
+		std::unique_ptr<MapChunk> map_chunk;
+
+		if (job.from_disk) {
+			map_chunk.reset(new MapChunk());
+			map_chunk->voxel_count = job.voxel_count;
+			if (!map_chunk->octree.Load(chunkFileName(job.chunk))) {
+
+				Logger::log("Could not load chunk from " + chunkFileName(job.chunk), Logger::LogLevel::ERROR, __LINE__, __FILE__);
+
+				std::lock_guard<std::mutex> lock(mutex);
+				unreadable.push_back(job.chunk);
+				building--;
+				counters.load_failures++;
+				continue;
+			}
+
+			// Copies the tree out of the whole pages mapped from the file, which for a
+			// chunk are mostly padding, and lets the file go
+			map_chunk->octree.Compact();
+		}
+		else {
+			map_chunk = map->generateChunk(job.chunk);
+		}
+
+		std::lock_guard<std::mutex> lock(mutex);
+		finished.push_back(std::make_pair(job.chunk, std::move(map_chunk)));
+		building--;
+		(job.from_disk ? counters.loaded : counters.generated)++;
+	}
+}
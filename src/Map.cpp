@@ -1,28 +1,601 @@
+#include <atomic>
+#include <climits>
+#include <thread>
 #include "Map.h"
 
 
 
-Map::Map(uint32_t dimensions) : array_map(Vector3i(dimensions, dimensions, dimensions)) {
+Map::Map(uint32_t dimensions, uint32_t chunk_dimensions, uint64_t seed) : chunk_dimensions(chunk_dimensions) {
 
-	if ((int)pow(2, (int)log2(dimensions)) != dimensions)
-		Logger::log("Map dimensions not an even exponent of 2", Logger::LogLevel::ERROR, __LINE__, __FILE__);
+	if ((int)pow(2, (int)log2(chunk_dimensions)) != chunk_dimensions)
+		Logger::log("Chunk dimensions not an even exponent of 2", Logger::LogLevel::ERROR, __LINE__, __FILE__);
 
-	Vector3i dim3(dimensions, dimensions, dimensions);
+	this->dimensions = Vector3i(dimensions, dimensions, dimensions);
+	chunk_shift = HighestBit(chunk_dimensions);
 
-	Logger::log("Generating Octree", Logger::LogLevel::INFO);
-	octree.Generate(array_map.getDataPtr(), dim3);
+	if (dimensions == 0)
+		return;
 
-	Logger::log("Validating Octree", Logger::LogLevel::INFO);
-	if (!octree.Validate(array_map.getDataPtr(), dim3)) {
-		Logger::log("Octree validation failed", Logger::LogLevel::ERROR, __LINE__, __FILE__);
+	Logger::log("Generating Octrees", Logger::LogLevel::INFO);
+	generateTerrain(dimensions, seed);
+}
+
+void Map::generateTerrain(uint32_t dimensions, uint64_t seed, bool caves, unsigned int thread_count) {
+
+	if (thread_count == 0)
+		thread_count = std::max(1u, std::thread::hardware_concurrency());
+
+	setTerrain(dimensions, seed, caves, thread_count);
+
+	Vector3i chunk_count = getChunkPosition(Vector3i(dimensions - 1, dimensions - 1, dimensions - 1)) + Vector3i(1, 1, 1);
+
+	// Each worker pulls the next slab of chunks one chunk deep in z, and keeps what it builds
+	// apart from the other slabs until they're all done
+	std::vector<std::vector<std::pair<Vector3i, std::unique_ptr<MapChunk>>>> slabs(chunk_count.z);
+	std::atomic<int> next_slab(0);
+
+	auto worker = [&]() {
+		int z;
+		while ((z = next_slab++) < chunk_count.z) {
+			for (int y = 0; y < chunk_count.y; y++) {
+				for (int x = 0; x < chunk_count.x; x++) {
+
+					// Built in Z-order as it's only there to generate and validate the octree from
+					ArrayMap array_map(Vector3i(chunk_dimensions, chunk_dimensions, chunk_dimensions), VoxelLayout::Morton);
+					fillChunk(Vector3i(x, y, z), Vector3i(dimensions, dimensions, dimensions), &array_map);
+
+					slabs[z].emplace_back(Vector3i(x, y, z), buildChunk(&array_map));
+				}
+			}
+		}
+	};
+
+	std::vector<std::thread> workers;
+	for (unsigned int i = 1; i < std::min(thread_count, (unsigned int)chunk_count.z); i++)
+		workers.emplace_back(worker);
+	worker();
+	for (std::thread &t : workers)
+		t.join();
+
+	for (auto &slab : slabs) {
+		for (auto &chunk : slab) {
+			if (chunk.second)
+				chunks[chunk.first] = std::move(chunk.second);
+			else
+				chunks.erase(chunk.first);
+		}
+	}
+}
+
+void Map::setTerrain(uint32_t dimensions, uint64_t seed, bool caves, unsigned int thread_count) {
+
+	if (thread_count == 0)
+		thread_count = std::max(1u, std::thread::hardware_concurrency());
+
+	terrain_dimensions = dimensions;
+	terrain_seed = seed;
+	terrain_caves = caves;
+
+	generateHeightMap(dimensions, seed, thread_count);
+}
+
+std::unique_ptr<MapChunk> Map::generateChunk(Vector3i chunk) {
+
+	if (terrain_dimensions == 0)
+		return nullptr;
+
+	ArrayMap array_map(Vector3i(chunk_dimensions, chunk_dimensions, chunk_dimensions), VoxelLayout::Morton);
+	fillChunk(chunk, Vector3i(INT_MAX, terrain_dimensions, INT_MAX), &array_map);
+
+	return buildChunk(&array_map);
+}
+
+void Map::generateHeightMap(uint32_t dimensions, uint64_t seed, unsigned int thread_count) {
+
+	height_map_size = 1;
+	while (height_map_size < (int)dimensions)
+		height_map_size <<= 1;
+
+	height_map.assign((size_t)height_map_size * height_map_size, 0.0);
+
+	uint64_t height_seed = HashRandom(seed, 1);
+
+	// Every point is set exactly once, so drawing by position keeps it the same on any thread
+	auto random = [&](int x, int y) {
+		return HashRandomUnit(height_seed, x, y, 0) * 2 - 1;
+	};
+
+	// Splits rows over the threads, each pass only reads what the passes before it wrote
+	auto parallel_rows = [&](int rows, const std::function<void(int)> &row) {
+
+		std::atomic<int> next_row(0);
+		auto worker = [&]() {
+			int i;
+			while ((i = next_row++) < rows)
+				row(i);
+		};
+
+		std::vector<std::thread> workers;
+		for (unsigned int i = 1; i < std::min(thread_count, (unsigned int)rows); i++)
+			workers.emplace_back(worker);
+		worker();
+		for (std::thread &t : workers)
+			t.join();
+	};
+
+	// Seeding a grid a quarter of the map apart keeps it from being one big hill
+	int feature_size = std::max(height_map_size / 4, 1);
+	for (int y = 0; y < height_map_size; y += feature_size)
+		for (int x = 0; x < height_map_size; x += feature_size)
+			SetSample(x, y, random(x, y), height_map.data());
+
+	double scale = 1.0;
+	for (int step = feature_size; step > 1; step /= 2) {
+
+		int half = step / 2;
+		int rows = height_map_size / step;
+
+		parallel_rows(rows, [&](int row) {
+			int y = row * step + half;
+			for (int x = half; x < height_map_size; x += step)
+				SampleSquare(x, y, step, random(x, y) * scale, height_map.data());
+		});
+
+		parallel_rows(rows, [&](int row) {
+			int y = row * step;
+			for (int x = 0; x < height_map_size; x += step) {
+				SampleDiamond(x + half, y, step, random(x + half, y) * scale, height_map.data());
+				SampleDiamond(x, y + half, step, random(x, y + half) * scale, height_map.data());
+			}
+		});
+
+		scale *= 0.5;
+	}
+
+	// Stretched out to fill 0 to 1
+	auto bounds = std::minmax_element(height_map.begin(), height_map.end());
+	double low = *bounds.first;
+	double range = std::max(*bounds.second - low, 1e-9);
+
+	for (double &height : height_map)
+		height = (height - low) / range;
+}
+
+double Map::Sample(int x, int y, double *height_map) {
+	return height_map[(x & (height_map_size - 1)) + (y & (height_map_size - 1)) * height_map_size];
+}
+
+void Map::SetSample(int x, int y, double value, double *height_map) {
+	height_map[(x & (height_map_size - 1)) + (y & (height_map_size - 1)) * height_map_size] = value;
+}
+
+void Map::SampleSquare(int x, int y, int size, double value, double *height_map) {
+
+	int half = size / 2;
+
+	double a = Sample(x - half, y - half, height_map);
+	double b = Sample(x + half, y - half, height_map);
+	double c = Sample(x - half, y + half, height_map);
+	double d = Sample(x + half, y + half, height_map);
+
+	SetSample(x, y, (a + b + c + d) / 4.0 + value, height_map);
+}
+
+void Map::SampleDiamond(int x, int y, int size, double value, double *height_map) {
+
+	int half = size / 2;
+
+	double a = Sample(x - half, y, height_map);
+	double b = Sample(x + half, y, height_map);
+	double c = Sample(x, y - half, height_map);
+	double d = Sample(x, y + half, height_map);
+
+	SetSample(x, y, (a + b + c + d) / 4.0 + value, height_map);
+}
+
+void Map::buildNoiseLattice(uint64_t seed, Vector3i origin, NoiseLattice* lattice) {
+
+	for (int octave = 0; octave < 3; octave++) {
+
+		int shift = 5 - octave;
+		Vector3i base(origin.x >> shift, origin.y >> shift, origin.z >> shift);
+
+		// The cells the chunk covers plus the far corner, the same on every axis as chunks
+		// are aligned to their size
+		int size = ((origin.x + (int)chunk_dimensions - 1) >> shift) - base.x + 2;
+
+		lattice->base[octave] = base;
+		lattice->size[octave] = size;
+		lattice->values[octave].resize((size_t)size * size * size);
+
+		for (int z = 0; z < size; z++)
+			for (int y = 0; y < size; y++)
+				for (int x = 0; x < size; x++)
+					lattice->values[octave][x + size * (y + size * z)] = HashRandomUnit(seed + octave, base.x + x, base.y + y, base.z + z);
+	}
+}
+
+double Map::Noise(NoiseLattice* lattice, int x, int y, int z) {
+
+	double total = 0;
+	double amplitude = 0.5;
+
+	for (int octave = 0; octave < 3; octave++) {
+
+		int shift = 5 - octave;
+		int mask = (1 << shift) - 1;
+		int size = lattice->size[octave];
+
+		// The lattice corners around the voxel, and how far it is between them smoothed out
+		Vector3i cell((x >> shift) - lattice->base[octave].x, (y >> shift) - lattice->base[octave].y, (z >> shift) - lattice->base[octave].z);
+		double f[3] = { (x & mask) / (double)(mask + 1), (y & mask) / (double)(mask + 1), (z & mask) / (double)(mask + 1) };
+		for (double &t : f)
+			t = t * t * (3 - 2 * t);
+
+		double corners[8];
+		for (int i = 0; i < 8; i++)
+			corners[i] = lattice->values[octave][(cell.x + (i & 1)) + size * ((cell.y + ((i >> 1) & 1)) + size * (cell.z + (i >> 2)))];
+
+		for (int i = 0; i < 4; i++)
+			corners[i] = corners[i * 2] + (corners[i * 2 + 1] - corners[i * 2]) * f[0];
+		for (int i = 0; i < 2; i++)
+			corners[i] = corners[i * 2] + (corners[i * 2 + 1] - corners[i * 2]) * f[1];
+
+		total += amplitude * (corners[0] + (corners[1] - corners[0]) * f[2]);
+		amplitude *= 0.5;
+	}
+
+	return total / 0.875;
+}
+
+void Map::fillChunk(Vector3i chunk, Vector3i bounds, ArrayMap* array_map) {
+
+	Vector3i origin(chunk.x * (int)chunk_dimensions, chunk.y * (int)chunk_dimensions, chunk.z * (int)chunk_dimensions);
+
+	// Nothing below the ground
+	if (origin.y + (int)chunk_dimensions <= 0)
+		return;
+
+	NoiseLattice lattice;
+	if (terrain_caves)
+		buildNoiseLattice(HashRandom(terrain_seed, 2), origin, &lattice);
+
+	// Column by column so the height is looked up once, chunks hanging over the bounds are
+	// left empty past them
+	for (int lz = 0; lz < (int)chunk_dimensions && origin.z + lz < bounds.z; lz++) {
+		for (int lx = 0; lx < (int)chunk_dimensions && origin.x + lx < bounds.x; lx++) {
+
+			int x = origin.x + lx;
+			int z = origin.z + lz;
+
+			double height = terrain_dimensions * (0.2 + 0.6 * Sample(x, z, height_map.data()));
+
+			for (int ly = std::max(0, -origin.y); ly < (int)chunk_dimensions && origin.y + ly < bounds.y; ly++) {
+
+				int y = origin.y + ly;
+				if (y >= height)
+					break;
+
+				// Stone with a few voxels of dirt on top and a grass surface
+				char material = 1;
+				if (y >= height - 1)
+					material = 3;
+				else if (y >= height - 4)
+					material = 2;
+
+				if (terrain_caves && Noise(&lattice, x, y, z) > 0.68)
+					material = 0;
+
+				array_map->setVoxel(Vector3i(lx, ly, lz), material);
+			}
+		}
+	}
+}
+
+std::unique_ptr<MapChunk> Map::buildChunk(ArrayMap* array_map) {
+
+	char* data = array_map->getDataPtr();
+	uint64_t voxel_count = std::count_if(data, data + ArrayMap::getSize(array_map->getLayout(), array_map->getDimensions()), [](char voxel) { return voxel != 0; });
+	if (voxel_count == 0)
+		return nullptr;
+
+	std::unique_ptr<MapChunk> map_chunk(new MapChunk());
+	map_chunk->voxel_count = voxel_count;
+	map_chunk->octree.Generate(array_map, 1);
+
+	ValidationReport report = map_chunk->octree.Validate(array_map, 1);
+	if (!report.valid()) {
+
+		Logger::log("Octree validation failed, " + std::to_string(report.mismatch_count) + " voxels don't match", Logger::LogLevel::ERROR, __LINE__, __FILE__);
+
+		for (VoxelMismatch &mismatch : report.mismatches) {
+			Logger::log("X: " + std::to_string(mismatch.position.x) + " Y: " + std::to_string(mismatch.position.y) + " Z: " + std::to_string(mismatch.position.z) +
+				" expected " + std::to_string(mismatch.expected) + " found " + std::to_string(mismatch.found), Logger::LogLevel::ERROR);
+		}
 	}
+
+	return map_chunk;
 }
 
 void Map::setVoxel(Vector3i pos, int val) {
-	array_map.getDataPtr()[pos.x + array_map.getDimensions().x * (pos.y + array_map.getDimensions().z * pos.z)] = val;
+
+	Vector3i chunk_position = getChunkPosition(pos);
+	Vector3i local = getLocalPosition(pos);
+
+	auto chunk = chunks.find(chunk_position);
+
+	if (chunk == chunks.end()) {
+
+		// Clearing a voxel in empty space doesn't need a chunk
+		if (val == 0)
+			return;
+
+		chunk = addEmptyChunk(chunk_position);
+	}
+
+	MapChunk* map_chunk = chunk->second.get();
+
+	bool was_set = map_chunk->octree.GetVoxel(local).value != 0;
+	map_chunk->octree.SetVoxel(local, val);
+
+	if (was_set && val == 0)
+		map_chunk->voxel_count--;
+	else if (!was_set && val != 0)
+		map_chunk->voxel_count++;
+
+	if (map_chunk->voxel_count == 0)
+		chunks.erase(chunk);
+}
+
+void Map::fillCube(IntCube cube, char value) {
+
+	fillChunks(cube, value, [&](Octree* octree, Vector3i origin) {
+		return octree->FillCube(IntCube(cube.left - origin.x, cube.top - origin.y, cube.front - origin.z, cube.width, cube.height, cube.depth), value);
+	}, [](IntCube) {
+		return true;
+	});
+}
+
+void Map::fillSphere(Vector3f center, float radius, char value) {
+
+	// Every voxel center within the radius, rounded out to whole voxels
+	IntCube bounds(
+		(int)std::floor(center.x - radius - 0.5f),
+		(int)std::floor(center.y - radius - 0.5f),
+		(int)std::floor(center.z - radius - 0.5f),
+		0, 0, 0
+	);
+	bounds.width = (int)std::ceil(center.x + radius + 0.5f) - bounds.left;
+	bounds.height = (int)std::ceil(center.y + radius + 0.5f) - bounds.top;
+	bounds.depth = (int)std::ceil(center.z + radius + 0.5f) - bounds.front;
+
+	fillChunks(bounds, value, [&](Octree* octree, Vector3i origin) {
+		return octree->FillSphere(Vector3f(center.x - origin.x, center.y - origin.y, center.z - origin.z), radius, value);
+	}, [&](IntCube chunk) {
+
+		// The corners of the bounds reach chunks the sphere itself doesn't
+		float distance = 0;
+		float c[3] = { center.x, center.y, center.z };
+		int low[3] = { chunk.left, chunk.top, chunk.front };
+		for (int a = 0; a < 3; a++) {
+			float nearest = std::min(std::max(c[a], low[a] + 0.5f), low[a] + chunk.width - 0.5f);
+			distance += (c[a] - nearest) * (c[a] - nearest);
+		}
+		return distance <= radius * radius;
+	});
+}
+
+template <typename Fill, typename Touches>
+void Map::fillChunks(IntCube bounds, char value, Fill fill, Touches touches) {
+
+	if (bounds.width <= 0 || bounds.height <= 0 || bounds.depth <= 0)
+		return;
+
+	Vector3i first = getChunkPosition(Vector3i(bounds.left, bounds.top, bounds.front));
+	Vector3i last = getChunkPosition(Vector3i(bounds.left + bounds.width - 1, bounds.top + bounds.height - 1, bounds.front + bounds.depth - 1));
+
+	for (int z = first.z; z <= last.z; z++) {
+		for (int y = first.y; y <= last.y; y++) {
+			for (int x = first.x; x <= last.x; x++) {
+
+				Vector3i chunk_position(x, y, z);
+				Vector3i origin(x * (int)chunk_dimensions, y * (int)chunk_dimensions, z * (int)chunk_dimensions);
+
+				IntCube chunk_cube(origin.x, origin.y, origin.z, chunk_dimensions, chunk_dimensions, chunk_dimensions);
+				if (!touches(chunk_cube))
+					continue;
+
+				auto chunk = chunks.find(chunk_position);
+				if (chunk == chunks.end()) {
+
+					// Carving empty space doesn't need a chunk
+					if (value == 0)
+						continue;
+
+					chunk = addEmptyChunk(chunk_position);
+				}
+
+				MapChunk* map_chunk = chunk->second.get();
+
+				map_chunk->voxel_count += fill(&map_chunk->octree, origin);
+				if (map_chunk->voxel_count == 0)
+					chunks.erase(chunk);
+			}
+		}
+	}
 }
 
 char Map::getVoxel(Vector3i pos) {
-	return array_map.getDataPtr()[pos.x + array_map.getDimensions().x * (pos.y + array_map.getDimensions().z * pos.z)];
-	return octree.GetVoxel(pos).found;
-}
\ No newline at end of file
+
+	auto chunk = chunks.find(getChunkPosition(pos));
+	if (chunk == chunks.end())
+		return 0;
+
+	return chunk->second->octree.GetVoxel(getLocalPosition(pos)).value;
+}
+
+uint64_t Map::countOccupied(IntCube region) {
+
+	uint64_t count = 0;
+	regionChunks(region, [&](MapChunk* chunk, Vector3i, IntCube local, bool whole) {
+		if (whole)
+			count += chunk->voxel_count;
+		else
+			count += chunk->octree.CountOccupied(local);
+		return true;
+	});
+
+	return count;
+}
+
+bool Map::anyOccupied(IntCube region) {
+
+	// Chunks only exist while something is set in them
+	bool any = false;
+	regionChunks(region, [&](MapChunk* chunk, Vector3i, IntCube local, bool whole) {
+		if (whole)
+			any = true;
+		else
+			any = chunk->octree.AnyOccupied(local);
+		return !any;
+	});
+
+	return any;
+}
+
+std::vector<OccupiedRegion> Map::findOccupied(IntCube region) {
+
+	std::vector<OccupiedRegion> regions;
+	regionChunks(region, [&](MapChunk* chunk, Vector3i origin, IntCube local, bool) {
+		for (OccupiedRegion occupied : chunk->octree.FindOccupied(local)) {
+			occupied.cube.left += origin.x;
+			occupied.cube.top += origin.y;
+			occupied.cube.front += origin.z;
+			regions.push_back(occupied);
+		}
+		return true;
+	});
+
+	return regions;
+}
+
+std::vector<Vector3i> Map::findOccupiedVoxels(IntCube region) {
+
+	std::vector<Vector3i> voxels;
+	regionChunks(region, [&](MapChunk* chunk, Vector3i origin, IntCube local, bool) {
+		for (const Vector3i &voxel : chunk->octree.FindOccupiedVoxels(local))
+			voxels.push_back(voxel + origin);
+		return true;
+	});
+
+	return voxels;
+}
+
+template <typename Visit>
+void Map::regionChunks(IntCube region, Visit visit) {
+
+	// Cubes can have negative sizes, work from the corners
+	Vector3i low(
+		std::min(region.left, region.left + region.width),
+		std::min(region.top, region.top + region.height),
+		std::min(region.front, region.front + region.depth)
+	);
+	Vector3i high(
+		std::max(region.left, region.left + region.width),
+		std::max(region.top, region.top + region.height),
+		std::max(region.front, region.front + region.depth)
+	);
+
+	if (low.x == high.x || low.y == high.y || low.z == high.z)
+		return;
+
+	Vector3i first = getChunkPosition(low);
+	Vector3i last = getChunkPosition(high - Vector3i(1, 1, 1));
+
+	auto visit_chunk = [&](const Vector3i &position, MapChunk* chunk) {
+
+		Vector3i origin(position.x * (int)chunk_dimensions, position.y * (int)chunk_dimensions, position.z * (int)chunk_dimensions);
+
+		IntCube local;
+		IntCube bounds(origin.x, origin.y, origin.z, chunk_dimensions, chunk_dimensions, chunk_dimensions);
+		region.intersects(bounds, local);
+
+		local.left -= origin.x;
+		local.top -= origin.y;
+		local.front -= origin.z;
+
+		return visit(chunk, origin, local, region.contains(bounds));
+	};
+
+	// A big region over a sparse world walks the chunks that exist rather than the ones it covers
+	uint64_t span = (uint64_t)(last.x - first.x + 1) * (last.y - first.y + 1) * (last.z - first.z + 1);
+
+	if (span > chunks.size()) {
+		for (auto &chunk : chunks) {
+			const Vector3i &position = chunk.first;
+			if (position.x < first.x || position.y < first.y || position.z < first.z ||
+				position.x > last.x || position.y > last.y || position.z > last.z)
+				continue;
+			if (!visit_chunk(position, chunk.second.get()))
+				return;
+		}
+		return;
+	}
+
+	for (int z = first.z; z <= last.z; z++) {
+		for (int y = first.y; y <= last.y; y++) {
+			for (int x = first.x; x <= last.x; x++) {
+				MapChunk* chunk = getChunk(Vector3i(x, y, z));
+				if (chunk != nullptr && !visit_chunk(Vector3i(x, y, z), chunk))
+					return;
+			}
+		}
+	}
+}
+
+std::unordered_map<Vector3i, std::unique_ptr<MapChunk>, XYZHasher>::iterator Map::addEmptyChunk(Vector3i chunk) {
+
+	// Starts out as a tree with nothing in it
+	std::vector<char> empty((size_t)chunk_dimensions * chunk_dimensions * chunk_dimensions, 0);
+	std::unique_ptr<MapChunk> map_chunk(new MapChunk());
+	map_chunk->octree.Generate(empty.data(), Vector3i(chunk_dimensions, chunk_dimensions, chunk_dimensions), 1);
+
+	return chunks.emplace(chunk, std::move(map_chunk)).first;
+}
+
+MapChunk* Map::getChunk(Vector3i chunk) {
+	auto found = chunks.find(chunk);
+	return found == chunks.end() ? nullptr : found->second.get();
+}
+
+Vector3i Map::getChunkPosition(Vector3i position) {
+	// Arithmetic shifts round down, so negative positions land in negative chunks
+	return Vector3i(position.x >> chunk_shift, position.y >> chunk_shift, position.z >> chunk_shift);
+}
+
+Vector3i Map::getLocalPosition(Vector3i position) {
+	int mask = chunk_dimensions - 1;
+	return Vector3i(position.x & mask, position.y & mask, position.z & mask);
+}
+
+void Map::compact() {
+	for (auto &chunk : chunks)
+		chunk.second->octree.Compact();
+}
+
+uint32_t Map::getChunkDimensions() {
+	return chunk_dimensions;
+}
+
+size_t Map::getChunkCount() {
+	return chunks.size();
+}
+
+uint64_t Map::getMemoryUsage() {
+
+	uint64_t bytes = chunks.bucket_count() * sizeof(void*);
+	for (auto &chunk : chunks)
+		bytes += sizeof(*chunk.second) + chunk.second->octree.MemoryUsage() + sizeof(chunk);
+
+	return bytes;
+}
@@ -0,0 +1,181 @@
+#include <algorithm>
+#include <fstream>
+#include "Logger.h"
+#include "Mesh.h"
+
+size_t Mesh::quadCount() const {
+	return values.size();
+}
+
+size_t Mesh::triangleCount() const {
+	return indices.size() / 3;
+}
+
+void Mesh::append(const Mesh &mesh) {
+
+	uint32_t first = (uint32_t)vertices.size();
+
+	vertices.insert(vertices.end(), mesh.vertices.begin(), mesh.vertices.end());
+	normals.insert(normals.end(), mesh.normals.begin(), mesh.normals.end());
+	values.insert(values.end(), mesh.values.begin(), mesh.values.end());
+
+	for (uint32_t index : mesh.indices)
+		indices.push_back(first + index);
+}
+
+void Mesh::addVoxels(const char* data, Vector3i dimensions, Vector3i origin) {
+
+	int size[3] = { dimensions.x - 2, dimensions.y - 2, dimensions.z - 2 };
+	if (size[0] <= 0 || size[1] <= 0 || size[2] <= 0)
+		return;
+
+	int64_t stride[3] = { 1, dimensions.x, (int64_t)dimensions.x * dimensions.y };
+
+	std::vector<char> mask;
+
+	for (int axis = 0; axis < 3; axis++) {
+
+		// The slice is spanned by the next two axes along, so u x v always points down the axis
+		int u_axis = (axis + 1) % 3;
+		int v_axis = (axis + 2) % 3;
+
+		int width = size[u_axis];
+		int height = size[v_axis];
+		mask.assign((size_t)width * height, 0);
+
+		for (int direction = -1; direction <= 1; direction += 2) {
+			for (int depth = 0; depth < size[axis]; depth++) {
+
+				// Values of the exposed faces in this slice, 0 where there's nothing to draw
+				bool any = false;
+				for (int v = 0; v < height; v++) {
+					for (int u = 0; u < width; u++) {
+
+						int position[3];
+						position[axis] = depth + 1;
+						position[u_axis] = u + 1;
+						position[v_axis] = v + 1;
+
+						int64_t index = position[0] * stride[0] + position[1] * stride[1] + position[2] * stride[2];
+						char value = data[index];
+						char neighbour = data[index + direction * stride[axis]];
+
+						char face = value != 0 && neighbour == 0 ? value : 0;
+						mask[(size_t)v * width + u] = face;
+						any |= face != 0;
+					}
+				}
+
+				if (!any)
+					continue;
+
+				// Grow each unclaimed face along u as far as it goes, then along v while the whole
+				// row matches, and clear what the rectangle took
+				for (int v = 0; v < height; v++) {
+					for (int u = 0; u < width; ) {
+
+						char value = mask[(size_t)v * width + u];
+						if (value == 0) {
+							u++;
+							continue;
+						}
+
+						int quad_width = 1;
+						while (u + quad_width < width && mask[(size_t)v * width + u + quad_width] == value)
+							quad_width++;
+
+						int quad_height = 1;
+						while (v + quad_height < height) {
+
+							bool row = true;
+							for (int i = 0; i < quad_width && row; i++)
+								row = mask[(size_t)(v + quad_height) * width + u + i] == value;
+
+							if (!row)
+								break;
+							quad_height++;
+						}
+
+						for (int j = 0; j < quad_height; j++)
+							std::fill(mask.begin() + (size_t)(v + j) * width + u, mask.begin() + (size_t)(v + j) * width + u + quad_width, 0);
+
+						addQuad(axis, direction, depth, u, v, quad_width, quad_height, origin, value);
+						u += quad_width;
+					}
+				}
+			}
+		}
+	}
+}
+
+void Mesh::addQuad(int axis, int direction, int depth, int u, int v, int width, int height, Vector3i origin, char value) {
+
+	int u_axis = (axis + 1) % 3;
+	int v_axis = (axis + 2) % 3;
+
+	// Faces pointing up the axis sit on the far side of their voxels
+	int plane = depth + (direction > 0 ? 1 : 0);
+
+	const int corners[4][2] = { { 0, 0 }, { width, 0 }, { width, height }, { 0, height } };
+	float offset[3] = { (float)origin.x, (float)origin.y, (float)origin.z };
+
+	uint32_t first = (uint32_t)vertices.size();
+
+	for (int i = 0; i < 4; i++) {
+
+		float corner[3];
+		corner[axis] = offset[axis] + plane;
+		corner[u_axis] = offset[u_axis] + u + corners[i][0];
+		corner[v_axis] = offset[v_axis] + v + corners[i][1];
+
+		vertices.push_back(Vector3f(corner[0], corner[1], corner[2]));
+
+		float normal[3] = { 0, 0, 0 };
+		normal[axis] = (float)direction;
+		normals.push_back(Vector3f(normal[0], normal[1], normal[2]));
+	}
+
+	// Counter clockwise seen from the side the face points to
+	if (direction > 0) {
+		indices.insert(indices.end(), { first, first + 1, first + 2, first, first + 2, first + 3 });
+	}
+	else {
+		indices.insert(indices.end(), { first, first + 2, first + 1, first, first + 3, first + 2 });
+	}
+
+	values.push_back(value);
+}
+
+bool Mesh::saveObj(std::string file_name) const {
+
+	std::ofstream file(file_name);
+	if (!file.is_open()) {
+		Logger::log("Couldn't open " + file_name, Logger::LogLevel::ERROR, __LINE__, __FILE__);
+		return false;
+	}
+
+	for (const Vector3f &vertex : vertices)
+		file << "v " << vertex.x << " " << vertex.y << " " << vertex.z << "\n";
+
+	for (const Vector3f &normal : normals)
+		file << "vn " << normal.x << " " << normal.y << " " << normal.z << "\n";
+
+	// OBJ indices start at 1, and every vertex has a normal at the same index
+	char material = 0;
+	for (size_t quad = 0; quad < values.size(); quad++) {
+
+		if (quad == 0 || values[quad] != material) {
+			material = values[quad];
+			file << "usemtl value_" << (int)material << "\n";
+		}
+
+		for (size_t triangle = quad * 6; triangle < quad * 6 + 6; triangle += 3) {
+			file << "f";
+			for (size_t i = triangle; i < triangle + 3; i++)
+				file << " " << indices[i] + 1 << "//" << indices[i] + 1;
+			file << "\n";
+		}
+	}
+
+	return file.good();
+}
@@ -1,62 +1,554 @@
+#include <atomic>
+#include <cmath>
+#include <limits>
 #include <cstring>
+#include <thread>
+#include "Logger.h"
 #include "Octree.h"
 
+#ifdef _WIN32
+#  define NOMINMAX
+#  include <windows.h>
+#else
+#  include <fcntl.h>
+#  include <sys/mman.h>
+#  include <sys/stat.h>
+#  include <unistd.h>
+#endif
+
+// First thing in a saved octree. Offsets are in bytes from the start of the file and counts are
+// in entries, every field is written in the byte order of the machine that saved it
+struct OctreeFileHeader {
+
+	char magic[8];
+	uint32_t version;
+	uint32_t header_size;
+	uint64_t byte_order;
+	uint64_t page_size;
+
+	uint64_t oct_dimensions;
+	uint64_t root_index;
+	uint64_t page_header_counter;
+	uint64_t flags;
+
+	uint64_t descriptor_offset;
+	uint64_t descriptor_count;
+	uint64_t attachment_lookup_offset;
+	uint64_t attachment_lookup_count;
+	uint64_t attachment_offset;
+	uint64_t attachment_count;
+	uint64_t edit_attachment_offset;
+	uint64_t edit_attachment_count;
+	uint64_t lod_offset;
+	uint64_t lod_count;
+};
+
+static const char octree_file_magic[8] = { 'O', 'C', 'T', 'A', 'L', 'O', 'T', 0 };
+static const uint64_t octree_file_byte_order = 0x0102030405060708;
+
+// Header flags
+static const uint64_t octree_file_deduplicated = 0x1;
+
 Octree::Octree() {
 
-	// initialize the the buffers to 0's
-	descriptor_buffer	= new uint64_t[buffer_size]();
-	attachment_lookup	= new uint32_t[buffer_size]();
-	attachment_buffer	= new uint64_t[buffer_size]();
+	// Until something is generated the tree is a single empty root
+	descriptor_buffer.push_back(0);
+	lod_buffer.push_back(0);
+}
+
+Octree::~Octree() {
+
+	// Drop the borrowed pages before the memory they point at goes away
+	descriptor_buffer.clear();
+	attachment_lookup.clear();
+	attachment_buffer.clear();
+	edit_attachment_buffer.clear();
+	lod_buffer.clear();
+
+	UnmapFile();
 }
 
-void Octree::Generate(char* data, Vector3i dimensions) {
+void Octree::Generate(ArrayMap* array_map, unsigned int thread_count) {
+	Generate(array_map->getDataPtr(), array_map->getDimensions(), thread_count, array_map->getLayout());
+}
+
+void Octree::Generate(char* data, Vector3i dimensions, unsigned int thread_count, VoxelLayout layout) {
+
+	revision++;
+	distance_buffer.clear();
 
 	oct_dimensions = dimensions.x;
 
-	// Launch the recursive generator at (0,0,0) as the first point
-	// and the octree dimension as the initial block size
-	std::tuple<uint64_t, uint64_t> root_node = GenerationRecursion(data, dimensions, Vector3i(0, 0, 0), oct_dimensions/2);
+	if (thread_count == 0)
+		thread_count = std::max(1u, std::thread::hardware_concurrency());
+
+	// One split level gives 8 subtrees which is enough work for up to 8 threads, past
+	// that we split another level for 64. Subtrees can't go below the leaf level
+	unsigned int split_level = 0;
+	if (thread_count > 1)
+		split_level = thread_count > 8 ? 2 : 1;
+	while (split_level > 0 && (oct_dimensions >> split_level) < 2)
+		split_level--;
+
+	DescriptorSegment trunk;
+	GeneratedNode root_node;
+
+	if (split_level == 0) {
+
+		// Launch the recursive generator at (0,0,0) as the first point
+		// and the octree dimension as the initial block size
+		root_node = GenerationRecursion(data, dimensions, layout, Vector3i(0, 0, 0), oct_dimensions / 2, 0, &trunk);
+	}
+	else {
+
+		unsigned int subtree_dimension = oct_dimensions >> split_level;
+		unsigned int subtrees_per_axis = 1 << split_level;
+		unsigned int subtree_count = subtrees_per_axis * subtrees_per_axis * subtrees_per_axis;
+
+		std::vector<DescriptorSegment> segments(subtree_count);
+		std::vector<GeneratedNode> subtrees(subtree_count);
+
+		// Each worker pulls the next unbuilt subtree until there are none left
+		std::atomic<unsigned int> next_subtree(0);
+		auto worker = [&]() {
+			unsigned int i;
+			while ((i = next_subtree++) < subtree_count) {
+
+				Vector3i pos(
+					(i % subtrees_per_axis) * subtree_dimension,
+					(i / subtrees_per_axis % subtrees_per_axis) * subtree_dimension,
+					(i / (subtrees_per_axis * subtrees_per_axis)) * subtree_dimension
+				);
+
+				subtrees[i] = GenerationRecursion(data, dimensions, layout, pos, subtree_dimension / 2, split_level, &segments[i]);
+			}
+		};
+
+		std::vector<std::thread> workers;
+		for (unsigned int i = 1; i < std::min(thread_count, subtree_count); i++)
+			workers.emplace_back(worker);
+		worker();
+		for (std::thread &t : workers)
+			t.join();
+
+		for (unsigned int i = 0; i < subtree_count; i++)
+			StitchSegment(&trunk, &segments[i], &subtrees[i]);
+
+		root_node = TrunkRecursion(Vector3i(0, 0, 0), oct_dimensions / 2, split_level, &subtrees, &trunk);
+	}
+
+	// The root is written as a block of its own so it gets a pointer to the top of the tree
+	root_index = WriteChildBlock(&trunk, &root_node, 1);
+
+	// The trunk now holds the whole tree, take over its pages and hand back the slack
+	descriptor_buffer = std::move(trunk.descriptors);
+	descriptor_buffer.trim();
+	compacted_size = descriptor_buffer.size();
+
+	BuildAttachments(&trunk.leaf_values);
+	edit_attachment_buffer.clear();
+
+	// Edits carry on writing into whatever is left of the last page
+	page_header_counter = trunk.page_header_counter;
+
+	build_stats = trunk.stats;
+	deduplicated = false;
+
+	// The level of detail reads the new tree through Descriptor so the page cache has to go
+	// first, and it lets go of the last pages borrowed from a loaded file
+	page_cache.reset();
+	BuildLevelOfDetail();
+	UnmapFile();
+}
+
+// Size of a buffer in the file, rounded up to whole pages
+template <typename T>
+static uint64_t FilePages(const PagedBuffer<T> &buffer) {
+	return (buffer.size() + PagedBuffer<T>::page_size - 1) / PagedBuffer<T>::page_size;
+}
+
+template <typename T>
+static void WriteFilePages(std::ofstream* file, uint64_t offset, PagedBuffer<T>* buffer) {
+
+	// Pad out to where the section starts
+	std::vector<char> padding(offset - file->tellp(), 0);
+	file->write(padding.data(), padding.size());
+
+	// A small first page is padded out to a whole one
+	for (uint64_t i = 0; i < FilePages(*buffer); i++) {
+		file->write((const char*)buffer->page(i), buffer->page_entries(i) * sizeof(T));
+		std::vector<char> page_padding((PagedBuffer<T>::page_size - buffer->page_entries(i)) * sizeof(T), 0);
+		file->write(page_padding.data(), page_padding.size());
+	}
+}
+
+bool Octree::Save(std::string octree_file_name) {
+
+	if (page_cache) {
+		Logger::log("A streamed octree is already saved", Logger::LogLevel::ERROR, __LINE__, __FILE__);
+		return false;
+	}
+
+	OctreeFileHeader header;
+	std::memset(&header, 0, sizeof(header));
+
+	std::memcpy(header.magic, octree_file_magic, sizeof(header.magic));
+	header.version = file_version;
+	header.header_size = sizeof(OctreeFileHeader);
+	header.byte_order = octree_file_byte_order;
+	header.page_size = page_size;
+
+	header.oct_dimensions = oct_dimensions;
+	header.root_index = root_index;
+	header.page_header_counter = page_header_counter;
+	header.flags = deduplicated ? octree_file_deduplicated : 0;
+
+	auto align = [](uint64_t offset) {
+		return (offset + file_alignment - 1) / file_alignment * file_alignment;
+	};
+
+	header.descriptor_offset = align(sizeof(OctreeFileHeader));
+	header.descriptor_count = descriptor_buffer.size();
+
+	header.attachment_lookup_offset = align(header.descriptor_offset + FilePages(descriptor_buffer) * page_size * sizeof(uint64_t));
+	header.attachment_lookup_count = attachment_lookup.size();
+
+	header.attachment_offset = align(header.attachment_lookup_offset + FilePages(attachment_lookup) * page_size * sizeof(uint32_t));
+	header.attachment_count = attachment_buffer.size();
+
+	header.edit_attachment_offset = align(header.attachment_offset + FilePages(attachment_buffer) * page_size * sizeof(uint64_t));
+	header.edit_attachment_count = edit_attachment_buffer.size();
+
+	header.lod_offset = align(header.edit_attachment_offset + FilePages(edit_attachment_buffer) * page_size * sizeof(uint64_t));
+	header.lod_count = lod_buffer.size();
+
+	std::ofstream file(octree_file_name, std::ios::binary);
+	if (!file.is_open()) {
+		Logger::log("Couldn't open " + octree_file_name + " to save the octree", Logger::LogLevel::ERROR, __LINE__, __FILE__);
+		return false;
+	}
+
+	file.write((const char*)&header, sizeof(header));
+
+	WriteFilePages(&file, header.descriptor_offset, &descriptor_buffer);
+	WriteFilePages(&file, header.attachment_lookup_offset, &attachment_lookup);
+	WriteFilePages(&file, header.attachment_offset, &attachment_buffer);
+	WriteFilePages(&file, header.edit_attachment_offset, &edit_attachment_buffer);
+	WriteFilePages(&file, header.lod_offset, &lod_buffer);
+
+	return file.good();
+}
+
+bool Octree::Load(std::string octree_file_name) {
+
+	revision++;
+	distance_buffer.clear();
+
+	void* data = nullptr;
+	uint64_t size = 0;
+
+#ifdef _WIN32
+	HANDLE file = CreateFileA(octree_file_name.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file != INVALID_HANDLE_VALUE) {
+
+		LARGE_INTEGER file_size;
+		if (GetFileSizeEx(file, &file_size) && file_size.QuadPart > 0) {
 
-	// ========= DEBUG ==============
-	PrettyPrintUINT64(std::get<0>(root_node), &output_stream);
-	output_stream << "    " << oct_dimensions << "    " << counter++ << std::endl;
-	// ==============================
+			// Copy on write, same as a private mapping
+			HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_WRITECOPY, 0, 0, NULL);
+			if (mapping != NULL) {
+				data = MapViewOfFile(mapping, FILE_MAP_COPY, 0, 0, 0);
+				size = file_size.QuadPart;
+				CloseHandle(mapping);
+			}
+		}
+		CloseHandle(file);
+	}
+#else
+	int file = open(octree_file_name.c_str(), O_RDONLY);
+	if (file >= 0) {
+
+		struct stat file_stat;
+		if (fstat(file, &file_stat) == 0 && file_stat.st_size > 0) {
+
+			data = mmap(nullptr, file_stat.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, file, 0);
+			size = file_stat.st_size;
+			if (data == MAP_FAILED)
+				data = nullptr;
+		}
+		close(file);
+	}
+#endif
+
+	if (data == nullptr) {
+		Logger::log("Couldn't map " + octree_file_name, Logger::LogLevel::ERROR, __LINE__, __FILE__);
+		return false;
+	}
+
+	const OctreeFileHeader &header = *(const OctreeFileHeader*)data;
+
+	if (size < sizeof(OctreeFileHeader) || !ValidFileHeader(header, size)) {
+
+#ifdef _WIN32
+		UnmapViewOfFile(data);
+#else
+		munmap(data, size);
+#endif
+		Logger::log(octree_file_name + " isn't an octree this version can load", Logger::LogLevel::ERROR, __LINE__, __FILE__);
+		return false;
+	}
+
+	char* bytes = (char*)data;
+
+	descriptor_buffer.borrow((uint64_t*)(bytes + header.descriptor_offset), header.descriptor_count);
+	compacted_size = descriptor_buffer.size();
+	attachment_lookup.borrow((uint32_t*)(bytes + header.attachment_lookup_offset), header.attachment_lookup_count);
+	attachment_buffer.borrow((uint64_t*)(bytes + header.attachment_offset), header.attachment_count);
+	edit_attachment_buffer.borrow((uint64_t*)(bytes + header.edit_attachment_offset), header.edit_attachment_count);
+	lod_buffer.borrow((uint8_t*)(bytes + header.lod_offset), header.lod_count);
+
+	oct_dimensions = (unsigned int)header.oct_dimensions;
+	root_index = header.root_index;
+	page_header_counter = (int)header.page_header_counter;
+	deduplicated = (header.flags & octree_file_deduplicated) != 0;
+	build_stats = OctreeBuildStats();
+
+	// Nothing points into the previous file anymore
+	UnmapFile();
+	page_cache.reset();
+
+	mapped_file = data;
+	mapped_file_size = size;
+
+	return true;
+}
+
+template <typename T>
+static bool ReadFilePages(std::ifstream* file, uint64_t offset, uint64_t count, PagedBuffer<T>* buffer) {
+
+	buffer->resize(count);
+
+	file->seekg(offset);
+	for (uint64_t i = 0; i < buffer->page_count(); i++) {
+		file->seekg(offset + i * PagedBuffer<T>::page_size * sizeof(T));
+		file->read((char*)buffer->page(i), buffer->page_entries(i) * sizeof(T));
+	}
+
+	return file->good();
+}
+
+bool Octree::Stream(std::string octree_file_name, uint64_t cache_pages) {
+
+	revision++;
+	distance_buffer.clear();
+
+	std::ifstream file(octree_file_name, std::ios::binary | std::ios::ate);
+	if (!file.is_open()) {
+		Logger::log("Couldn't open " + octree_file_name, Logger::LogLevel::ERROR, __LINE__, __FILE__);
+		return false;
+	}
+
+	uint64_t size = file.tellg();
+	file.seekg(0);
 
-    // set the root nodes relative pointer to 1 because the next element will be the top of the tree, and push to the stack
-    std::get<0>(root_node) |= 1;    
-	memcpy(&descriptor_buffer[descriptor_buffer_position], &std::get<0>(root_node), sizeof(uint64_t));
-	
-    root_index = descriptor_buffer_position;
-    descriptor_buffer_position--;
+	OctreeFileHeader header;
+	std::memset(&header, 0, sizeof(header));
+	if (size >= sizeof(OctreeFileHeader))
+		file.read((char*)&header, sizeof(header));
 
-	DumpLog(&output_stream, "raw_output.txt");
-	output_stream.str("");
+	if (!file.good() || !ValidFileHeader(header, size)) {
+		Logger::log(octree_file_name + " isn't an octree this version can stream", Logger::LogLevel::ERROR, __LINE__, __FILE__);
+		return false;
+	}
 
-	for (int i = 0; i < buffer_size; i++) {
-		PrettyPrintUINT64(descriptor_buffer[i], &output_stream);
-		output_stream << std::endl;
+	std::unique_ptr<PageCache> cache(new PageCache(octree_file_name, header.descriptor_offset, header.descriptor_count, cache_pages));
+
+	// The attachments are small next to the descriptors so they're read in whole
+	PagedBuffer<uint32_t> lookup;
+	PagedBuffer<uint64_t> attachments;
+	PagedBuffer<uint64_t> edit_attachments;
+	PagedBuffer<uint8_t> lod;
+
+	if (!cache->is_open() ||
+		!ReadFilePages(&file, header.attachment_lookup_offset, header.attachment_lookup_count, &lookup) ||
+		!ReadFilePages(&file, header.attachment_offset, header.attachment_count, &attachments) ||
+		!ReadFilePages(&file, header.edit_attachment_offset, header.edit_attachment_count, &edit_attachments) ||
+		!ReadFilePages(&file, header.lod_offset, header.lod_count, &lod)) {
+		Logger::log("Couldn't read " + octree_file_name, Logger::LogLevel::ERROR, __LINE__, __FILE__);
+		return false;
 	}
 
-	DumpLog(&output_stream, "raw_data.txt");
+	descriptor_buffer.clear();
+	attachment_lookup = std::move(lookup);
+	attachment_buffer = std::move(attachments);
+	edit_attachment_buffer = std::move(edit_attachments);
+	lod_buffer = std::move(lod);
+	page_cache = std::move(cache);
+
+	oct_dimensions = (unsigned int)header.oct_dimensions;
+	root_index = header.root_index;
+	page_header_counter = (int)header.page_header_counter;
+	deduplicated = (header.flags & octree_file_deduplicated) != 0;
+	build_stats = OctreeBuildStats();
+
+	UnmapFile();
+
+	return true;
+}
+
+bool Octree::ValidFileHeader(const OctreeFileHeader &header, uint64_t file_size) {
+
+	// Every section has to be aligned and lie inside the file as whole pages
+	auto section_fits = [&](uint64_t offset, uint64_t count, uint64_t entry_size) {
+		uint64_t bytes = (count + page_size - 1) / page_size * page_size * entry_size;
+		return offset % file_alignment == 0 && offset <= file_size && bytes <= file_size - offset;
+	};
+
+	return std::memcmp(header.magic, octree_file_magic, sizeof(header.magic)) == 0 &&
+		header.version == file_version &&
+		header.header_size == sizeof(OctreeFileHeader) &&
+		header.byte_order == octree_file_byte_order &&
+		header.page_size == page_size &&
+		header.root_index < header.descriptor_count &&
+		section_fits(header.descriptor_offset, header.descriptor_count, sizeof(uint64_t)) &&
+		section_fits(header.attachment_lookup_offset, header.attachment_lookup_count, sizeof(uint32_t)) &&
+		section_fits(header.attachment_offset, header.attachment_count, sizeof(uint64_t)) &&
+		section_fits(header.edit_attachment_offset, header.edit_attachment_count, sizeof(uint64_t)) &&
+		header.lod_count == header.descriptor_count &&
+		section_fits(header.lod_offset, header.lod_count, sizeof(uint8_t));
+}
+
+void Octree::UnmapFile() {
 
+	if (mapped_file == nullptr)
+		return;
+
+#ifdef _WIN32
+	UnmapViewOfFile(mapped_file);
+#else
+	munmap(mapped_file, mapped_file_size);
+#endif
+
+	mapped_file = nullptr;
+	mapped_file_size = 0;
 }
 
-OctState Octree::GetVoxel(Vector3i position) {
+OctState Octree::GetVoxel(Vector3i position, unsigned int max_depth) {
 
 	// Struct that holds the state necessary to continue the traversal from the found voxel
 	OctState state;
 
-	state.oct_pos = Vector3i(0,0,0);
-
 	// push the root node to the parent stack
-    uint64_t current_index = root_index;
-    uint64_t head = descriptor_buffer[current_index];
-    
-    //PrettyPrintUINT64(head);
-	state.parent_stack[state.parent_stack_position] = head;
-	state.parent_stack_index[state.parent_stack_position] = current_index;
-	// Set our initial dimension and the position at the corner of the oct to keep track of our position
-	int dimension = oct_dimensions;
+	state.parent_stack[state.parent_stack_position] = Descriptor(root_index);
+	state.parent_stack_index[state.parent_stack_position] = root_index;
+
+	Traverse(&state, position, max_depth);
+	return state;
+}
+
+void Octree::GetVoxels(const Vector3i* positions, size_t count, char* results) {
+
+	if (count == 0)
+		return;
+
+	unsigned int levels = 0;
+	while ((1u << levels) < oct_dimensions)
+		levels++;
+
+	// Sort the queries into Morton order so neighbouring queries share as much of their path
+	// through the tree as possible. This is an LSD radix sort over only the bits the codes use
+	std::vector<uint64_t> keys(count);
+	std::vector<uint32_t> order(count);
+	for (size_t i = 0; i < count; i++) {
+		keys[i] = MortonEncode(positions[i].x, positions[i].y, positions[i].z);
+		order[i] = (uint32_t)i;
+	}
+
+	const int radix_bits = 11;
+	const uint64_t radix_mask = (1 << radix_bits) - 1;
+
+	std::vector<uint64_t> sorted_keys(count);
+	std::vector<uint32_t> sorted_order(count);
+	std::vector<size_t> buckets(radix_mask + 1);
+
+	for (unsigned int shift = 0; shift < levels * 3; shift += radix_bits) {
+
+		std::fill(buckets.begin(), buckets.end(), 0);
+		for (size_t i = 0; i < count; i++)
+			buckets[(keys[i] >> shift) & radix_mask]++;
+
+		size_t total = 0;
+		for (size_t &bucket : buckets) {
+			size_t bucket_count = bucket;
+			bucket = total;
+			total += bucket_count;
+		}
+
+		for (size_t i = 0; i < count; i++) {
+			size_t destination = buckets[(keys[i] >> shift) & radix_mask]++;
+			sorted_keys[destination] = keys[i];
+			sorted_order[destination] = order[i];
+		}
+
+		keys.swap(sorted_keys);
+		order.swap(sorted_order);
+	}
+
+	OctState state;
+	state.parent_stack[0] = Descriptor(root_index);
+	state.parent_stack_index[0] = root_index;
+
+	// The positions come straight back out of the sorted codes rather than being
+	// gathered out of the input in sorted order
+	uint64_t previous = keys[0];
+	Traverse(&state, Vector3i(MortonCompact(previous), MortonCompact(previous >> 1), MortonCompact(previous >> 2)));
+	results[order[0]] = state.value;
+
+	for (size_t i = 1; i < count; i++) {
+
+		// The highest bit that differs between this code and the last one is the level their
+		// paths through the tree split at, everything above that is shared
+		uint64_t difference = keys[i] ^ previous;
+		previous = keys[i];
+
+		if (difference == 0) {
+			results[order[i]] = state.value;
+			continue;
+		}
+
+		unsigned int split_scale = levels - 1 - HighestBit(difference) / 3;
+
+		// If the last traversal stopped above the split then this position ends up in
+		// the same leaf and gets the same answer
+		if (split_scale > state.scale) {
+			results[order[i]] = state.value;
+			continue;
+		}
+
+		// Otherwise pop back up to the split and descend again from there
+		state.scale = split_scale;
+		state.parent_stack_position = split_scale;
+		Traverse(&state, Vector3i(MortonCompact(keys[i]), MortonCompact(keys[i] >> 1), MortonCompact(keys[i] >> 2)));
+
+		results[order[i]] = state.value;
+	}
+}
+
+void Octree::Traverse(OctState* state_ptr, Vector3i position, unsigned int max_depth) {
+
+	OctState &state = *state_ptr;
+
+	// Pick up from the node at the current scale
+	uint64_t current_index = state.parent_stack_index[state.scale];
+	uint64_t head = state.parent_stack[state.scale];
+
+	// Set our dimension and the position at the corner of the oct to keep track of our position
+	int dimension = oct_dimensions >> state.scale;
+	state.oct_pos = Vector3i(
+		position.x & ~(dimension - 1),
+		position.y & ~(dimension - 1),
+		position.z & ~(dimension - 1)
+	);
 
 	// While we are not at the required resolution
 	//		Traverse down by setting the valid/leaf mask to the subvoxel
@@ -70,6 +562,18 @@ OctState Octree::GetVoxel(Vector3i position) {
 	//				Break
 	while (dimension > 1) {
 
+		// Deep enough for the level of detail that was asked for, the node answers for
+		// everything under it
+		if (state.scale >= max_depth) {
+			state.found = 1;
+			state.value = (char)lod_buffer[current_index];
+			state.coverage = (head >> 56) / 255.0f;
+			return;
+		}
+
+		// Clear out whatever idx a previous traversal left at this scale
+		state.idx_stack[state.scale] = 0;
+
 		// Do the logic steps to find which sub oct we step down into
 		if (position.x >= (dimension / 2) + state.oct_pos.x) {
 
@@ -109,30 +613,17 @@ OctState Octree::GetVoxel(Vector3i position) {
 
 				// If it is, then we cannot traverse further as CP's won't have been generated
 				state.found = 1;
-				return state;
+				state.value = LeafValue(current_index, head, mask_index);
+				state.coverage = 1;
+				return;
 			}
 
 			// If all went well and we found a valid non-leaf oct then we will traverse further down the hierarchy
 			state.scale++;
 			dimension /= 2;
 
-			// Count the number of valid octs that come before and add it to the index to get the position
-			// Negate it by one as it counts itself
-			int count = count_bits((uint8_t)(head >> 16) & count_mask_8[mask_index]) - 1;
-
-			// access the far point at which the head points too. Determine it's value, and add
-			// a count of the valid bits to the index
-			if (far_bit_mask & descriptor_buffer[current_index]) {
-				int far_pointer_index = current_index + (head & child_pointer_mask);
-				current_index = descriptor_buffer[far_pointer_index] + count;
-			} 
-			// access the element at which head points to and then add the specified number of indices
-			// to get to the correct child descriptor
-			else {
-				current_index = current_index + (head & child_pointer_mask) + count;
-			}
-
-			head = descriptor_buffer[current_index];
+			current_index = ChildIndex(current_index, head, mask_index);
+			head = Descriptor(current_index);
 
 			// Increment the parent stack position and put the new oct node as the parent
 			state.parent_stack_position++;
@@ -148,18 +639,216 @@ OctState Octree::GetVoxel(Vector3i position) {
 			// Currently it adds the last parent on the second to lowest
 			// oct CP. Not sure if thats correct
 			state.found = 0;
-			return state;
+			state.value = 0;
+			state.coverage = 0;
+			return;
 		}
 	}
 
 	state.found = 1;
-	return state;
+}
+
+uint64_t Octree::ChildIndex(uint64_t parent_index, uint64_t descriptor, int idx) {
+
+	// Count the number of valid non-leaf octs that come before and add it to the index to get the
+	// position, valid leafs don't get a descriptor. Negate it by one as it counts itself
+	int count = count_bits((uint8_t)((descriptor >> 16) & ~(descriptor >> 24)) & count_mask_8[idx]) - 1;
+
+	return ChildBlockPosition(parent_index, descriptor) + count;
+}
+
+uint64_t Octree::ChildBlockPosition(uint64_t parent_index, uint64_t descriptor) {
+
+	// access the far point at which the head points too and return it's value
+	if (far_bit_mask & descriptor) {
+		uint64_t far_pointer_index = parent_index - (descriptor & child_pointer_mask);
+		return Descriptor(far_pointer_index);
+	}
+
+	// otherwise the child block is the element at which head points to
+	return parent_index - (descriptor & child_pointer_mask);
+}
+
+RayHit Octree::CastRay(Vector3f origin, Vector3f direction, float max_distance, float lod_factor) {
+
+	RayHit result;
+
+	float length = std::sqrt(direction.x * direction.x + direction.y * direction.y + direction.z * direction.z);
+	if (length == 0)
+		return result;
+
+	float o[3] = { origin.x, origin.y, origin.z };
+	float d[3] = { direction.x / length, direction.y / length, direction.z / length };
+	float dim = (float)oct_dimensions;
+
+	// Mirror the axes the ray travels down so it always travels up every axis. Child idx's
+	// are flipped back with the octant mask when they're read out of the descriptors.
+	// Tiny direction components are nudged off of 0 to keep the divisions finite
+	const float epsilon = 1e-7f;
+	int octant_mask = 0;
+	float t_coef[3];
+	float t_bias[3];
+
+	for (int a = 0; a < 3; a++) {
+
+		if (std::fabs(d[a]) < epsilon)
+			d[a] = d[a] < 0 ? -epsilon : epsilon;
+
+		if (d[a] < 0) {
+			o[a] = dim - o[a];
+			d[a] = -d[a];
+			octant_mask |= 1 << a;
+		}
+
+		// The ray reaches the plane at x along this axis at t = x * coef + bias
+		t_coef[a] = 1.0f / d[a];
+		t_bias[a] = -o[a] * t_coef[a];
+	}
+
+	// Clip the ray against the root cube
+	float t_min = std::max(std::max(t_bias[0], t_bias[1]), std::max(t_bias[2], 0.0f));
+	float t_max = std::min(std::min(dim * t_coef[0] + t_bias[0], dim * t_coef[1] + t_bias[1]), std::min(dim * t_coef[2] + t_bias[2], max_distance));
+
+	if (t_min > t_max)
+		return result;
+
+	unsigned int levels = 0;
+	while ((1u << levels) < oct_dimensions)
+		levels++;
+
+	// Same parent stack as the OctState, indexed by scale
+	uint64_t parent_stack[32];
+	uint64_t parent_stack_index[32];
+	int scale = 0;
+
+	parent_stack_index[0] = root_index;
+	parent_stack[0] = Descriptor(root_index);
+
+	// Corner of the current child in mirrored space, its size, and its idx in the parent
+	int pos[3] = { 0, 0, 0 };
+	int child_size = oct_dimensions / 2;
+	int idx = 0;
+
+	// Start in the child that contains the point the ray enters the root at
+	for (int a = 0; a < 3; a++) {
+		if (child_size * t_coef[a] + t_bias[a] <= t_min) {
+			idx |= 1 << a;
+			pos[a] = child_size;
+		}
+	}
+
+	while (true) {
+
+		// Where the ray leaves the current child on each axis, it leaves through the nearest one
+		float t_exit[3];
+		for (int a = 0; a < 3; a++)
+			t_exit[a] = (pos[a] + child_size) * t_coef[a] + t_bias[a];
+		float tc_max = std::min(std::min(t_exit[0], t_exit[1]), t_exit[2]);
+
+		uint64_t head = parent_stack[scale];
+		int child = idx ^ octant_mask;
+
+		// PUSH, or hit if the child is a valid leaf or too small to be worth descending into
+		if ((head >> 16) & mask_8[child]) {
+
+			bool leaf = ((head >> 24) & mask_8[child]) != 0;
+
+			if (leaf || child_size <= lod_factor * t_min) {
+
+				result.hit = true;
+				result.distance = t_min;
+
+				if (leaf) {
+					result.value = LeafValue(parent_stack_index[scale], head, child);
+					result.coverage = 1;
+				}
+				else {
+					uint64_t child_index = ChildIndex(parent_stack_index[scale], head, child);
+					result.value = (char)lod_buffer[child_index];
+					result.coverage = (Descriptor(child_index) >> 56) / 255.0f;
+				}
+
+				// Leafs bigger than a voxel get the voxel the ray enters them at
+				int entry_axis = 0;
+				float t_entry = pos[0] * t_coef[0] + t_bias[0];
+				for (int a = 0; a < 3; a++) {
+
+					int voxel = pos[a];
+					if (child_size > 1) {
+						voxel = (int)std::floor(o[a] + d[a] * t_min);
+						voxel = std::min(std::max(voxel, pos[a]), pos[a] + child_size - 1);
+					}
+
+					float t_face = pos[a] * t_coef[a] + t_bias[a];
+					if (t_face > t_entry) {
+						t_entry = t_face;
+						entry_axis = a;
+					}
+
+					// Flip mirrored axes back
+					if (octant_mask & (1 << a))
+						voxel = oct_dimensions - 1 - voxel;
+
+					(&result.voxel.x)[a] = voxel;
+				}
+
+				// If the ray started inside the voxel it didn't come in through a face
+				if (t_entry > 0)
+					(&result.normal.x)[entry_axis] = (octant_mask & (1 << entry_axis)) ? 1 : -1;
+
+				return result;
+			}
+
+			scale++;
+			parent_stack_index[scale] = ChildIndex(parent_stack_index[scale - 1], head, child);
+			parent_stack[scale] = Descriptor(parent_stack_index[scale]);
+
+			child_size /= 2;
+			idx = 0;
+
+			for (int a = 0; a < 3; a++) {
+				if ((pos[a] + child_size) * t_coef[a] + t_bias[a] <= t_min) {
+					idx |= 1 << a;
+					pos[a] += child_size;
+				}
+			}
+
+			continue;
+		}
+
+		// ADVANCE into the next child along the ray
+		t_min = tc_max;
+		if (t_min > t_max)
+			return result;
+
+		uint32_t differing_bits = 0;
+		for (int a = 0; a < 3; a++) {
+			if (t_exit[a] <= tc_max) {
+				differing_bits |= pos[a] ^ (pos[a] + child_size);
+				pos[a] += child_size;
+				if (pos[a] >= (int)oct_dimensions)
+					return result;
+			}
+		}
+
+		// POP. The highest bit that changed is the size of the child we stepped into, so its
+		// parent is the node one size up. If we stayed in the same parent that's this scale
+		int size_bit = HighestBit(differing_bits);
+		scale = levels - 1 - size_bit;
+		child_size = 1 << size_bit;
+
+		idx = 0;
+		for (int a = 0; a < 3; a++) {
+			pos[a] &= ~(child_size - 1);
+			idx |= ((pos[a] >> size_bit) & 1) << a;
+		}
+	}
 }
 
 void Octree::print_block(int block_pos) {
 
 	std::stringstream sss;
-	for (int i = block_pos; i < (int)pow(2, 15); i++) {
+	for (uint64_t i = block_pos; i < std::min(descriptor_buffer.size(), (uint64_t)block_pos + page_size); i++) {
 		PrettyPrintUINT64(descriptor_buffer[i], &sss);
 		sss << "\n";
 	}
@@ -167,12 +856,15 @@ void Octree::print_block(int block_pos) {
 
 }
 
-std::tuple<uint64_t, uint64_t> Octree::GenerationRecursion(char* data, Vector3i dimensions, Vector3i pos, unsigned int voxel_scale) {
+GeneratedNode Octree::GenerationRecursion(char* data, Vector3i dimensions, VoxelLayout layout, Vector3i pos, unsigned int voxel_scale, unsigned int depth, DescriptorSegment* segment) {
+
+	// This runs once per node so nothing in here touches the heap, everything lives on the stack
 
+	segment->stats.max_depth = std::max(segment->stats.max_depth, depth);
 
 	// The 8 subvoxel coords starting from the 1th direction, the direction of the origin of the 3d grid
 	// XY, Z++, XY
-	std::vector<Vector3i> v = {
+	const Vector3i v[8] = {
 		Vector3i(pos.x              , pos.y              , pos.z),
 		Vector3i(pos.x + voxel_scale, pos.y              , pos.z),
 		Vector3i(pos.x              , pos.y + voxel_scale, pos.z),
@@ -183,9 +875,10 @@ std::tuple<uint64_t, uint64_t> Octree::GenerationRecursion(char* data, Vector3i
 		Vector3i(pos.x + voxel_scale, pos.y + voxel_scale, pos.z + voxel_scale)
 	};
 
-	// A tuple holding the child descriptor that we're going to fill out and the
-	// absolute position of it within the descriptor buffer
-	std::tuple<uint64_t, uint64_t> descriptor_and_position(0, 0);
+	// A tuple holding the child descriptor that we're going to fill out, the
+	// absolute position of its child block within the descriptor buffer and
+	// the values of its leaf children
+	GeneratedNode descriptor_and_position(0, 0, 0);
 
 
 	// If we hit the 1th voxel scale then we need to query the 3D grid
@@ -193,161 +886,1971 @@ std::tuple<uint64_t, uint64_t> Octree::GenerationRecursion(char* data, Vector3i
 	// want to do chunking / loading of raw data I can edit the voxel access
 	if (voxel_scale == 1) {
 		
-		// Setting the individual valid mask bits
+		// Setting the individual valid mask bits and packing the voxel values
 		// These don't bound check, should they?
-		for (int i = 0; i < v.size(); i++) {
-			if (get1DIndexedVoxel(data, dimensions, v.at(i)))
+		uint64_t values = GetVoxelBlock(data, dimensions, layout, pos);
+		std::get<2>(descriptor_and_position) = values;
+		for (int i = 0; i < 8; i++) {
+			if ((values >> (i * 8)) & 0xFF)
 				SetBit(i + 16, &std::get<0>(descriptor_and_position));
 		}
 
 		// We are querying leafs, so we need to fill the leaf mask
 		std::get<0>(descriptor_and_position) |= 0xFF000000;
 
-		// The CP will be left blank, contour mask and ptr will need to 
-		// be added here later
+		// The CP will be left blank, the contour pointer to the values is
+		// filled in by BuildAttachments once the descriptor is placed
 		return descriptor_and_position;
 
 	}
 
-	// Array of <descriptors, position>
-	std::vector<std::tuple<uint64_t, uint64_t>> descriptor_position_array;
+	// Array of <descriptors, position, values> for the children that need a descriptor, at most all 8
+	GeneratedNode descriptor_position_array[8];
+	int descriptor_position_array_size = 0;
 
 	// Generate down the recursion, returning the descriptor of the current node
-	for (int i = 0; i < v.size(); i++) {
-
-		std::tuple<uint64_t, uint64_t> child(0, 0);
+	for (int i = 0; i < 8; i++) {
 
 		// Get the child descriptor from the i'th to 8th subvoxel
-		child = GenerationRecursion(data, dimensions, v.at(i), voxel_scale / 2);
+		GeneratedNode child = GenerationRecursion(data, dimensions, layout, v[i], voxel_scale / 2, depth + 1, segment);
 
-		// =========== Debug ===========
-		PrettyPrintUINT64(std::get<0>(child), &output_stream);
-		output_stream << "    " << voxel_scale << "    " << counter++ << std::endl;
-		// =============================
+		AttachChild(i, child, &descriptor_and_position, descriptor_position_array, &descriptor_position_array_size);
+	}
 
-		// If the child is a leaf (contiguous) of non-valid values
-		if (IsLeaf(std::get<0>(child)) && !CheckLeafSign(std::get<0>(child))) {
-			// Leave the valid mask 0, set leaf mask to 1
-			SetBit(i + 16 + 8, &std::get<0>(descriptor_and_position));
-		}
+	std::get<1>(descriptor_and_position) = WriteChildBlock(segment, descriptor_position_array, descriptor_position_array_size);
 
-		// If the child is valid and not a leaf
-		else {
+	// Return the node up the stack
+	return descriptor_and_position;
+}
 
-			// Set the valid mask, and add it to the descriptor array
-			SetBit(i + 16, &std::get<0>(descriptor_and_position));
-			descriptor_position_array.push_back(child);
-		}
+GeneratedNode Octree::TrunkRecursion(Vector3i pos, unsigned int voxel_scale, unsigned int split_level, std::vector<GeneratedNode>* subtrees, DescriptorSegment* segment) {
+
+	// We've reached the split, pick up the subtree that was generated for this position
+	if (split_level == 0) {
+
+		unsigned int subtree_dimension = voxel_scale * 2;
+		unsigned int subtrees_per_axis = oct_dimensions / subtree_dimension;
+
+		unsigned int i = pos.x / subtree_dimension +
+			subtrees_per_axis * (pos.y / subtree_dimension + subtrees_per_axis * (pos.z / subtree_dimension));
+
+		return subtrees->at(i);
 	}
-	
-	// We are working bottom up so we need to subtract from the stack position
-	// the amount of elements we want to use. In the worst case this will be 
-	// a far pointer for ever descriptor (size * 2)
-	
-	int worst_case_insertion_size = descriptor_position_array.size() * 2;
 
-	// check to see if we exceeded this page header, if so set the header and move the global position
-	if (page_header_counter - worst_case_insertion_size <= 0) {
-		
-		// Jump to the page headers position and reset the counter
-		descriptor_buffer_position -= page_header_counter;
-		page_header_counter = 0x8000;
+	GeneratedNode descriptor_and_position(0, 0, 0);
+	GeneratedNode descriptor_position_array[8];
+	int descriptor_position_array_size = 0;
 
-		// Fill the space with blank
-		memcpy(&descriptor_buffer[descriptor_buffer_position], &current_info_section_position, sizeof(uint64_t));
+	for (int i = 0; i < 8; i++) {
 
-		descriptor_buffer_position--;
+		Vector3i child_pos(
+			pos.x + ((i & idx_set_x_mask) ? voxel_scale : 0),
+			pos.y + ((i & idx_set_y_mask) ? voxel_scale : 0),
+			pos.z + ((i & idx_set_z_mask) ? voxel_scale : 0)
+		);
 
-	} 
+		GeneratedNode child = TrunkRecursion(child_pos, voxel_scale / 2, split_level - 1, subtrees, segment);
 
-	unsigned int far_pointer_count = 0;
+		AttachChild(i, child, &descriptor_and_position, descriptor_position_array, &descriptor_position_array_size);
+	}
 
-	// If looking "up" to zero, the far ptr is entered first before the cp block. Get it's position
-	uint64_t far_pointer_block_position = descriptor_buffer_position;
+	std::get<1>(descriptor_and_position) = WriteChildBlock(segment, descriptor_position_array, descriptor_position_array_size);
 
-	// Count the far pointers we need to allocate 
-	for (int i = descriptor_position_array.size() - 1; i >= 0; i--) {
-	
-		// this is not the actual relative distance write, so we pessimistically guess that we will have
-		// the worst relative distance via the insertion size
-		int relative_distance = std::get<1>(descriptor_position_array.at(i)) - (descriptor_buffer_position - worst_case_insertion_size);
+	return descriptor_and_position;
+}
 
-		// check to see if we tripped the far pointer
-		if (relative_distance > 0x8000) {
+void Octree::AttachChild(int i, GeneratedNode child, GeneratedNode* parent, GeneratedNode* child_block, int* child_block_size) {
 
-			// This is writing the ABSOLUTE POSITION for far pointers, is this what I want?
-			memcpy(&descriptor_buffer[descriptor_buffer_position], &std::get<1>(descriptor_position_array.at(i)), sizeof(uint64_t));
-			descriptor_buffer_position--;
-			page_header_counter--;
+	uint64_t* descriptor = &std::get<0>(*parent);
 
-			far_pointer_count++;
-		}
+	// If the child is a leaf (contiguous) of non-valid values
+	if (IsLeaf(std::get<0>(child)) && !CheckLeafSign(std::get<0>(child))) {
+		// Leave the valid mask 0, set leaf mask to 1
+		SetBit(i + 16 + 8, descriptor);
 	}
 
-	// We gotta go backwards as memcpy of a vector can be emulated by starting from the rear
-	for (int i = descriptor_position_array.size() - 1; i >= 0; i--) {
-		
-		// just gonna redo the far pointer check loosing a couple of cycles but oh well
-		int relative_distance = std::get<1>(descriptor_position_array.at(i)) - descriptor_buffer_position;
+	// If the child is a leaf of valid values that are all the same, it collapses into a
+	// single valid leaf in the parent that carries the value
+	else if (IsLeaf(std::get<0>(child)) && IsUniform(std::get<2>(child))) {
+		SetBit(i + 16, descriptor);
+		SetBit(i + 16 + 8, descriptor);
+		std::get<2>(*parent) |= (std::get<2>(child) & 0xFF) << (i * 8);
+	}
 
-		uint64_t descriptor = std::get<0>(descriptor_position_array.at(i));
+	// If the child is valid and not a leaf
+	else {
 
-		// check to see if the 
-		if (relative_distance > 0x8000) {
+		// Set the valid mask, and add it to the descriptor array
+		SetBit(i + 16, descriptor);
+		child_block[(*child_block_size)++] = child;
+	}
+}
 
-			descriptor |= far_bit_mask;
-			// The distance from this cp to the far ptr
-			descriptor |= far_pointer_block_position - descriptor_buffer_position;
+uint64_t Octree::WriteChildBlock(DescriptorSegment* segment, GeneratedNode* child_block, int child_block_size) {
 
-			far_pointer_block_position--;
-		
-		} else if (relative_distance > 0) {
-		
-			descriptor |= (uint64_t)relative_distance;
-				
+	PagedBuffer<uint64_t> &buffer = segment->descriptors;
+
+	// An identical block has already been written, share it
+	ChildBlockKey key;
+	if (segment->deduplicate && child_block_size > 0) {
+
+		key.size = child_block_size;
+		std::copy(child_block, child_block + child_block_size, key.children);
+
+		// Where a child block went only matters if the child has one
+		for (int i = 0; i < child_block_size; i++) {
+			if (!HasChildBlock(std::get<0>(key.children[i])))
+				std::get<1>(key.children[i]) = 0;
 		}
 
-		// We have finished building the CD so we push it onto the buffer
-		memcpy(&descriptor_buffer[descriptor_buffer_position], &descriptor, sizeof(uint64_t));
-		descriptor_buffer_position--;
-		page_header_counter--;
+		auto written = segment->written_blocks.find(key);
+		if (written != segment->written_blocks.end()) {
+			segment->stats.shared_blocks++;
+			return written->second;
+		}
 	}
 
-    // The position this descriptor points to is the last one written to the stack. AKA
-    // the current stack position (empty slot) plus one
-	std::get<1>(descriptor_and_position) = descriptor_buffer_position + 1;
+	// In the worst case every descriptor in the block needs a far pointer (size * 2)
+	int worst_case_insertion_size = child_block_size * 2;
 
-	// Return the node up the stack
-	return descriptor_and_position;
-}
+	// Blocks don't straddle pages. If this one won't fit, pad out the rest of the
+	// page and start the next one with its header
+	if (segment->page_header_counter - worst_case_insertion_size <= 0) {
 
-char Octree::get1DIndexedVoxel(char* data, Vector3i dimensions, Vector3i position) {	
-	return data[position.x + oct_dimensions * (position.y + oct_dimensions * position.z)];
-}
+		buffer.resize(buffer.size() + segment->page_header_counter);
+		buffer.push_back(current_info_section_position);
+
+		segment->page_header_counter = page_size - 1;
+		segment->stats.page_headers++;
+	}
 
-bool Octree::Validate(char* data, Vector3i dimensions){
+	// Far pointers are written first and the block directly after. We pessimistically assume every
+	// descriptor needs a far pointer when checking the distances so that a descriptor which fits a
+	// relative pointer here still fits once the real positions are known
+	uint64_t worst_case_block_position = buffer.size() + child_block_size;
 
-	for (int x = 0; x < dimensions.x; x++) {
-		for (int y = 0; y < dimensions.y; y++) {
-			for (int z = 0; z < dimensions.z; z++) {
+	bool far[8] = { false };
+	uint64_t far_pointer_position[8] = { 0 };
 
-				Vector3i pos(x, y, z);
+	for (int i = 0; i < child_block_size; i++) {
 
-                char arr_val = get1DIndexedVoxel(data, dimensions, pos);
-                char oct_val = GetVoxel(pos).found;
+		if (!HasChildBlock(std::get<0>(child_block[i])))
+			continue;
 
+		uint64_t relative_distance = worst_case_block_position + i - std::get<1>(child_block[i]);
 
-				if (arr_val != oct_val && (oct_val == 0 || arr_val == 0)) {
-					std::cout << "X: " << pos.x << " Y: " << pos.y << " Z: " << pos.z << "   ";
-                    std::cout << (int)arr_val << "  :  " << (int)oct_val << std::endl;
-					//return false;
-				}
+		if (relative_distance > child_pointer_mask) {
 
-			}
+			// Far pointers hold the ABSOLUTE position of the child block
+			far[i] = true;
+			far_pointer_position[i] = buffer.size();
+			segment->far_pointers.push_back(buffer.size());
+			buffer.push_back(std::get<1>(child_block[i]));
+			segment->page_header_counter--;
+			segment->stats.far_pointers++;
 		}
 	}
 
-	return true;
+	uint64_t block_position = buffer.size();
+
+	for (int i = 0; i < child_block_size; i++) {
+
+		uint64_t descriptor = std::get<0>(child_block[i]);
+		uint64_t descriptor_position = block_position + i;
+
+		if (far[i]) {
+
+			descriptor |= far_bit_mask;
+			// The distance from this cp back to its far ptr
+			descriptor |= descriptor_position - far_pointer_position[i];
+
+		} else if (HasChildBlock(descriptor)) {
+
+			descriptor |= descriptor_position - std::get<1>(child_block[i]);
+		}
+
+		// The leaf values ride along at the same position until BuildAttachments packs them
+		if (segment->collect_leaf_values) {
+			segment->leaf_values.resize(buffer.size());
+			segment->leaf_values.push_back(std::get<2>(child_block[i]));
+		}
+
+		// We have finished building the CD so we push it onto the buffer
+		buffer.push_back(descriptor);
+		segment->page_header_counter--;
+		segment->stats.nodes++;
+	}
+
+	if (segment->deduplicate && child_block_size > 0)
+		segment->written_blocks[key] = block_position;
+
+	return block_position;
+}
+
+void Octree::StitchSegment(DescriptorSegment* trunk, DescriptorSegment* segment, GeneratedNode* subtree) {
+
+	PagedBuffer<uint64_t> &descriptors = segment->descriptors;
+
+	// A subtree right above the leaf level doesn't write any descriptors
+	if (descriptors.size() == 0)
+		return;
+
+	// Position in the trunk that the start of the segment maps to
+	uint64_t base;
+
+	// If the segment is a single page and fits in what's left of the trunks current page
+	// it gets copied in there, minus its own page header
+	if (descriptors.size() - 1 <= (uint64_t)trunk->page_header_counter) {
+
+		base = trunk->descriptors.size() - 1;
+		for (uint64_t i = 1; i < descriptors.size(); i++)
+			trunk->descriptors.push_back(descriptors[i]);
+
+		trunk->leaf_values.resize(base + 1);
+		for (uint64_t i = 1; i < segment->leaf_values.size(); i++)
+			trunk->leaf_values.push_back(segment->leaf_values[i]);
+
+		trunk->page_header_counter -= descriptors.size() - 1;
+		segment->stats.page_headers--;
+	}
+	// Otherwise skip to the end of the trunks current page and hand the segments pages
+	// over to the trunk as they are, they bring their own page headers
+	else {
+
+		base = trunk->descriptors.size() + trunk->page_header_counter;
+		trunk->descriptors.resize(base);
+		trunk->descriptors.append_pages(std::move(descriptors));
+
+		trunk->leaf_values.resize(base);
+		trunk->leaf_values.append_pages(std::move(segment->leaf_values));
+
+		trunk->page_header_counter = segment->page_header_counter;
+	}
+
+	for (uint64_t i = 0; i < segment->far_pointers.size(); i++) {
+		uint64_t far_pointer = segment->far_pointers[i];
+		trunk->descriptors[base + far_pointer] += base;
+		trunk->far_pointers.push_back(base + far_pointer);
+	}
+
+	trunk->stats.Add(segment->stats);
+
+	if (HasChildBlock(std::get<0>(*subtree)))
+		std::get<1>(*subtree) += base;
+
+	// Free up whatever is left of the segment
+	*segment = DescriptorSegment();
+}
+
+bool Octree::HasChildBlock(uint64_t descriptor) {
+	return ((descriptor >> 16) & ~(descriptor >> 24) & 0xFF) != 0;
+}
+
+bool Octree::IsUniform(uint64_t leaf_values) {
+	return leaf_values == (leaf_values & 0xFF) * 0x0101010101010101;
+}
+
+void Octree::BuildAttachments(PagedBuffer<uint64_t>* leaf_values) {
+
+	attachment_lookup.clear();
+	attachment_buffer.clear();
+
+	leaf_values->resize(descriptor_buffer.size());
+
+	for (uint64_t page = 0; page < descriptor_buffer.page_count(); page++) {
+
+		uint64_t first = page * page_size;
+		uint64_t last = std::min(first + page_size, descriptor_buffer.size());
+
+		// Gather the distinct values used by the valid leafs in this page into its palette
+		bool used[256] = { false };
+		for (uint64_t i = first; i < last; i++) {
+
+			uint64_t values = (*leaf_values)[i];
+			uint8_t leafs = (uint8_t)((descriptor_buffer[i] >> 16) & (descriptor_buffer[i] >> 24));
+
+			for (int c = 0; values && c < 8; c++)
+				if (leafs & mask_8[c])
+					used[(values >> (c * 8)) & 0xFF] = true;
+		}
+
+		uint8_t palette[256];
+		uint8_t palette_index[256];
+		int palette_size = 0;
+		for (int value = 0; value < 256; value++) {
+			if (used[value]) {
+				palette_index[value] = palette_size;
+				palette[palette_size++] = value;
+			}
+		}
+
+		// Indices are packed at a power of two width so they never straddle a word, a page
+		// with a single value doesn't need any
+		int bits = 0;
+		while ((1 << bits) < palette_size)
+			bits++;
+		if (bits == 3)
+			bits = 4;
+		else if (bits > 4)
+			bits = 8;
+
+		// Page section: header, palette (8 values a word), then the packed index stream
+		attachment_lookup.push_back((uint32_t)attachment_buffer.size());
+		attachment_buffer.push_back((uint64_t)palette_size | ((uint64_t)bits << 16));
+
+		for (int i = 0; i < palette_size; i += 8) {
+			uint64_t word = 0;
+			for (int j = i; j < std::min(i + 8, palette_size); j++)
+				word |= (uint64_t)palette[j] << ((j - i) * 8);
+			attachment_buffer.push_back(word);
+		}
+
+		// Each descriptor with valid leafs gets a contour pointer to its first index in the stream
+		uint64_t ordinal = 0;
+		uint64_t word = 0;
+		int word_bits = 0;
+
+		for (uint64_t i = first; i < last; i++) {
+
+			uint64_t values = (*leaf_values)[i];
+			if (!values)
+				continue;
+
+			uint8_t leafs = (uint8_t)((descriptor_buffer[i] >> 16) & (descriptor_buffer[i] >> 24));
+			descriptor_buffer[i] = (descriptor_buffer[i] & ~contour_pointer_mask) | (ordinal << 32);
+
+			for (int c = 0; c < 8; c++) {
+
+				if (!(leafs & mask_8[c]))
+					continue;
+
+				ordinal++;
+				if (bits == 0)
+					continue;
+
+				word |= (uint64_t)palette_index[(values >> (c * 8)) & 0xFF] << word_bits;
+				word_bits += bits;
+				if (word_bits == 64) {
+					attachment_buffer.push_back(word);
+					word = 0;
+					word_bits = 0;
+				}
+			}
+		}
+
+		if (word_bits > 0)
+			attachment_buffer.push_back(word);
+	}
+
+	attachment_lookup.trim();
+	attachment_buffer.trim();
+}
+
+char Octree::LeafValue(uint64_t index, uint64_t descriptor, int idx) {
+
+	// Descriptors written by edits keep all 8 values in a word of their own
+	if (descriptor & contour_edit_bit)
+		return (char)(edit_attachment_buffer[(descriptor & contour_pointer_mask & ~contour_edit_bit) >> 32] >> (idx * 8));
+
+	uint64_t section = attachment_lookup[index / page_size];
+	uint64_t header = attachment_buffer[section];
+
+	uint64_t palette_size = header & 0xFFFF;
+	int bits = (header >> 16) & 0xFF;
+
+	uint64_t palette_index = 0;
+
+	if (bits) {
+
+		// The leafs values are stored in child order starting at the contour pointer
+		uint8_t leafs = (uint8_t)((descriptor >> 16) & (descriptor >> 24));
+		uint64_t ordinal = ((descriptor & contour_pointer_mask) >> 32) + count_bits(leafs & count_mask_8[idx]) - 1;
+
+		uint64_t stream = section + 1 + (palette_size + 7) / 8;
+		uint64_t bit = ordinal * bits;
+		palette_index = (attachment_buffer[stream + bit / 64] >> (bit % 64)) & ((1 << bits) - 1);
+	}
+
+	return (char)(attachment_buffer[section + 1 + palette_index / 8] >> ((palette_index % 8) * 8));
+}
+
+uint64_t Octree::LeafValues(uint64_t index, uint64_t descriptor) {
+
+	if (descriptor & contour_edit_bit)
+		return edit_attachment_buffer[(descriptor & contour_pointer_mask & ~contour_edit_bit) >> 32];
+
+	uint64_t values = 0;
+	uint8_t leafs = (uint8_t)((descriptor >> 16) & (descriptor >> 24));
+	if (!leafs)
+		return values;
+
+	uint64_t section = attachment_lookup[index / page_size];
+	uint64_t header = attachment_buffer[section];
+
+	uint64_t palette_size = header & 0xFFFF;
+	int bits = (header >> 16) & 0xFF;
+
+	// The leafs are stored one after the other in the stream, walk them in child order
+	uint64_t stream = section + 1 + (palette_size + 7) / 8;
+	uint64_t bit = ((descriptor & contour_pointer_mask) >> 32) * bits;
+
+	for (int i = 0; i < 8; i++) {
+
+		if (!(leafs & mask_8[i]))
+			continue;
+
+		uint64_t palette_index = 0;
+		if (bits) {
+			palette_index = (attachment_buffer[stream + bit / 64] >> (bit % 64)) & ((1 << bits) - 1);
+			bit += bits;
+		}
+
+		values |= ((attachment_buffer[section + 1 + palette_index / 8] >> ((palette_index % 8) * 8)) & 0xFF) << (i * 8);
+	}
+
+	return values;
+}
+
+uint64_t Octree::MemoryUsage() {
+	return descriptor_buffer.memory_usage() + attachment_lookup.memory_usage() + attachment_buffer.memory_usage()
+		+ edit_attachment_buffer.memory_usage() + lod_buffer.memory_usage() + distance_buffer.memory_usage()
+		+ (page_cache ? page_cache->memory_usage() : 0);
+}
+
+void Octree::SetVoxel(Vector3i position, char value) {
+
+	if (oct_dimensions < 2 ||
+		position.x < 0 || position.y < 0 || position.z < 0 ||
+		position.x >= (int)oct_dimensions || position.y >= (int)oct_dimensions || position.z >= (int)oct_dimensions)
+		return;
+
+	if (page_cache) {
+		Logger::log("Streamed octrees are read only", Logger::LogLevel::ERROR, __LINE__, __FILE__);
+		return;
+	}
+
+	revision++;
+
+	// Setting voxels can bring them nearer than the bounds say, carving only ever leaves
+	// the bounds lower than they need to be
+	if (value != 0)
+		distance_buffer.clear();
+
+	CompactIfGrown();
+
+	// A single edit hands out at most 8 edit attachments a level, make sure they'll fit
+	if (edit_attachment_buffer.size() + 8 * 32 >= (contour_edit_bit >> 32))
+		Compact();
+
+	OctState state = GetVoxel(position);
+	if (state.value == value)
+		return;
+
+	unsigned int levels = 0;
+	while ((1u << levels) < oct_dimensions)
+		levels++;
+
+	// The deepest node on the path, and the child of it the voxel lies in
+	int node_scale = state.parent_stack_position;
+	int idx = state.idx_stack[node_scale];
+	uint64_t index = state.parent_stack_index[node_scale];
+	uint64_t head = state.parent_stack[node_scale];
+
+	// The child is a single voxel so only this descriptors masks and values change, which can
+	// be done in place unless the node could be shared. If that leaves the node uniform it's
+	// collapsed on the next Compact
+	if (node_scale == (int)levels - 1 && !deduplicated) {
+
+		uint64_t values = LeafValues(index, head);
+		values &= ~((uint64_t)0xFF << (idx * 8));
+		values |= (uint64_t)(uint8_t)value << (idx * 8);
+
+		if (value)
+			SetBit(idx + 16, &head);
+		else
+			head &= ~((uint64_t)mask_8[idx] << 16);
+
+		GeneratedNode node(head, 0, values);
+		AssignEditAttachment(&node);
+		descriptor_buffer[index] = std::get<0>(node);
+
+		UpdateLevelOfDetail(state);
+		return;
+	}
+
+	// Otherwise the child is a leaf covering more than one voxel and has to be split down to the
+	// voxel, or the node is shared, and every node above it gets a new copy pointing at the new
+	// child. Read everything
+	// needed from the old path before the buffer is handed to the segment to be written to
+	GeneratedNode path_children[32][8];
+	uint8_t path_child_values[32][9];
+	for (int scale = 0; scale <= node_scale; scale++)
+		CopyChildren(state.parent_stack_index[scale], state.parent_stack[scale], path_children[scale], path_child_values[scale]);
+
+	DescriptorSegment edits;
+	edits.descriptors = std::move(descriptor_buffer);
+	edits.page_header_counter = page_header_counter;
+	edits.collect_leaf_values = false;
+
+	// The split region keeps the value it had everywhere apart from the edited voxel
+	uint64_t fill_values = (uint64_t)(uint8_t)state.value * 0x0101010101010101;
+	GeneratedNode fill(leaf_mask | (state.value ? valid_mask : 0), 0, fill_values);
+
+	GeneratedNode node(leaf_mask | (value ? valid_mask : 0), 0, (uint64_t)(uint8_t)value * 0x0101010101010101);
+
+	// Representative values of the children at each level, with the new node's own in the last slot
+	uint8_t child_values[9] = { 0 };
+
+	for (int scale = (int)levels - 1; scale >= 0; scale--) {
+
+		GeneratedNode children[8];
+		GeneratedNode* node_children = path_children[scale];
+		uint8_t node_value = child_values[8];
+
+		int bit = levels - 1 - scale;
+		int child = ((position.x >> bit) & 1) | (((position.y >> bit) & 1) << 1) | (((position.z >> bit) & 1) << 2);
+
+		if (scale > node_scale) {
+			for (int i = 0; i < 8; i++)
+				children[i] = fill;
+			node_children = children;
+		}
+
+		node_children[child] = node;
+		node = EditNode(node_children, &edits);
+
+		if (scale <= node_scale)
+			std::copy(path_child_values[scale], path_child_values[scale] + 8, child_values);
+		child_values[child] = node_value;
+
+		lod_buffer.resize(edits.descriptors.size());
+		EditLevelOfDetail(&node, node_children, child_values);
+	}
+
+	AssignEditAttachment(&node);
+	root_index = WriteChildBlock(&edits, &node, 1);
+
+	descriptor_buffer = std::move(edits.descriptors);
+	page_header_counter = edits.page_header_counter;
+
+	lod_buffer.resize(descriptor_buffer.size());
+	lod_buffer[root_index] = child_values[8];
+}
+
+int64_t Octree::FillCube(IntCube cube, char value) {
+
+	EditShape shape;
+	shape.sphere = false;
+	shape.cube = cube;
+	shape.radius = 0;
+
+	return FillShape(shape, value);
+}
+
+int64_t Octree::FillSphere(Vector3f center, float radius, char value) {
+
+	EditShape shape;
+	shape.sphere = true;
+	shape.center = center;
+	shape.radius = radius;
+
+	return FillShape(shape, value);
+}
+
+int Octree::ClassifyShape(const EditShape &shape, Vector3i pos, unsigned int size) {
+
+	if (!shape.sphere) {
+		IntCube node(pos.x, pos.y, pos.z, size, size, size);
+		if (!shape.cube.intersects(node))
+			return -1;
+		return shape.cube.contains(node) ? 1 : 0;
+	}
+
+	// The nearest and furthest voxel centers of the node from the center of the sphere
+	float center[3] = { shape.center.x, shape.center.y, shape.center.z };
+	int corner[3] = { pos.x, pos.y, pos.z };
+	float nearest = 0;
+	float furthest = 0;
+
+	for (int a = 0; a < 3; a++) {
+
+		float low = corner[a] + 0.5f;
+		float high = corner[a] + size - 0.5f;
+
+		float near_offset = center[a] - std::min(std::max(center[a], low), high);
+		float far_offset = std::max(std::fabs(center[a] - low), std::fabs(center[a] - high));
+
+		nearest += near_offset * near_offset;
+		furthest += far_offset * far_offset;
+	}
+
+	float radius_squared = shape.radius * shape.radius;
+	if (nearest > radius_squared)
+		return -1;
+	return furthest <= radius_squared ? 1 : 0;
+}
+
+int64_t Octree::FillShape(const EditShape &shape, char value) {
+
+	if (oct_dimensions < 2 || ClassifyShape(shape, Vector3i(0, 0, 0), oct_dimensions) < 0)
+		return 0;
+
+	if (page_cache) {
+		Logger::log("Streamed octrees are read only", Logger::LogLevel::ERROR, __LINE__, __FILE__);
+		return 0;
+	}
+
+	revision++;
+
+	// Setting voxels can bring them nearer than the bounds say, carving only ever leaves
+	// the bounds lower than they need to be
+	if (value != 0)
+		distance_buffer.clear();
+
+	CompactIfGrown();
+
+	// Every node the edit rebuilds takes an edit attachment and there's no telling how many
+	// that will be up front, so start with plenty of room
+	if (edit_attachment_buffer.size() >= (contour_edit_bit >> 32) / 2)
+		Compact();
+
+	// The edit only ever writes onto the end of the buffers, so until the root is swapped over
+	// it can be dropped leaving the old tree as it was. If it runs out of edit attachments it's
+	// tried once more on a compacted tree
+	for (int attempt = 0; ; attempt++) {
+
+		DescriptorSegment edits;
+		edits.page_header_counter = page_header_counter;
+		edits.collect_leaf_values = false;
+
+		uint64_t edit_attachment_count = edit_attachment_buffer.size();
+		edit_attachments_full = false;
+
+		uint8_t root_value = 0;
+		int64_t set_voxels = 0;
+		GeneratedNode root = FillRecursion(shape, value, true, root_index, Descriptor(root_index), 0, Vector3i(0, 0, 0), oct_dimensions, &edits, &root_value, &set_voxels);
+
+		AssignEditAttachment(&root);
+
+		if (edit_attachments_full) {
+
+			edit_attachments_full = false;
+			edit_attachment_buffer.resize(edit_attachment_count);
+
+			if (attempt == 0) {
+				Compact();
+				continue;
+			}
+
+			Logger::log("Edit needs more edit attachments than the contour pointer can index", Logger::LogLevel::ERROR, __LINE__, __FILE__);
+			return 0;
+		}
+
+		edits.descriptors = std::move(descriptor_buffer);
+		root_index = WriteChildBlock(&edits, &root, 1);
+		descriptor_buffer = std::move(edits.descriptors);
+		page_header_counter = edits.page_header_counter;
+
+		lod_buffer.resize(descriptor_buffer.size());
+		lod_buffer[root_index] = root_value;
+
+		return set_voxels;
+	}
+}
+
+GeneratedNode Octree::FillRecursion(const EditShape &shape, char value, bool has_descriptor, uint64_t index, uint64_t descriptor, char old_value, Vector3i pos, unsigned int size, DescriptorSegment* segment, uint8_t* node_value, int64_t* set_voxels) {
+
+	GeneratedNode children[8];
+	uint8_t child_values[9] = { 0 };
+
+	if (has_descriptor) {
+		CopyChildren(index, descriptor, children, child_values);
+	}
+	else {
+		for (int i = 0; i < 8; i++)
+			children[i] = GeneratedNode(leaf_mask | (old_value ? valid_mask : 0), 0, (uint64_t)(uint8_t)old_value * 0x0101010101010101);
+	}
+
+	GeneratedNode fill(leaf_mask | (value ? valid_mask : 0), 0, (uint64_t)(uint8_t)value * 0x0101010101010101);
+	unsigned int child_size = size / 2;
+
+	for (int i = 0; i < 8; i++) {
+
+		Vector3i child_pos(
+			pos.x + (i & idx_set_x_mask ? child_size : 0),
+			pos.y + (i & idx_set_y_mask ? child_size : 0),
+			pos.z + (i & idx_set_z_mask ? child_size : 0)
+		);
+
+		int coverage = ClassifyShape(shape, child_pos, child_size);
+		if (coverage < 0)
+			continue;
+
+		bool child_has_descriptor = has_descriptor && ((descriptor >> 16) & ~(descriptor >> 24) & mask_8[i]);
+		char child_value = (char)(std::get<2>(children[i]) & 0xFF);
+
+		if (coverage > 0) {
+
+			// What the child held is counted before it's replaced, a subtree by walking it
+			int64_t child_volume = (int64_t)child_size * child_size * child_size;
+			if (child_has_descriptor)
+				*set_voxels -= (int64_t)SubtreeOccupied(ChildIndex(index, descriptor, i), child_pos, child_size);
+			else if (std::get<0>(children[i]) & valid_mask)
+				*set_voxels -= child_volume;
+
+			if (value)
+				*set_voxels += child_volume;
+
+			children[i] = fill;
+			continue;
+		}
+
+		// Only the children the surface of the shape passes through are descended into. A leaf
+		// that already holds the value stays as it is
+
+		if (!child_has_descriptor && child_value == value)
+			continue;
+
+		uint64_t child_index = child_has_descriptor ? ChildIndex(index, descriptor, i) : 0;
+		uint64_t child_descriptor = child_has_descriptor ? Descriptor(child_index) : 0;
+
+		children[i] = FillRecursion(shape, value, child_has_descriptor, child_index, child_descriptor, child_value, child_pos, child_size, segment, &child_values[i], set_voxels);
+	}
+
+	// The segment writes onto the end of the tree, which has to be handed back before anything
+	// reads from it again
+	segment->descriptors = std::move(descriptor_buffer);
+	GeneratedNode node = EditNode(children, segment);
+	descriptor_buffer = std::move(segment->descriptors);
+
+	lod_buffer.resize(descriptor_buffer.size());
+	EditLevelOfDetail(&node, children, child_values);
+
+	*node_value = child_values[8];
+	return node;
+}
+
+void Octree::BuildLevelOfDetail() {
+
+	lod_buffer.clear();
+	lod_buffer.resize(descriptor_buffer.size());
+
+	std::vector<bool> done(descriptor_buffer.size(), false);
+	LevelOfDetailRecursion(root_index, &done);
+
+	lod_buffer.trim();
+}
+
+void Octree::LevelOfDetailRecursion(uint64_t index, std::vector<bool>* done) {
+
+	if ((*done)[index])
+		return;
+
+	uint64_t descriptor = descriptor_buffer[index];
+	for (int i = 0; i < 8; i++)
+		if ((descriptor >> 16) & ~(descriptor >> 24) & mask_8[i])
+			LevelOfDetailRecursion(ChildIndex(index, descriptor, i), done);
+
+	SetLevelOfDetail(index);
+	(*done)[index] = true;
+}
+
+void Octree::SetLevelOfDetail(uint64_t index) {
+
+	uint64_t descriptor = descriptor_buffer[index];
+	uint64_t leaf_values = LeafValues(index, descriptor);
+
+	uint8_t child_values[8] = { 0 };
+	for (int i = 0; i < 8; i++)
+		if ((descriptor >> 16) & ~(descriptor >> 24) & mask_8[i])
+			child_values[i] = lod_buffer[ChildIndex(index, descriptor, i)];
+
+	uint64_t coverage_descriptor = descriptor;
+	uint8_t value = CombineLevelOfDetail(&coverage_descriptor, leaf_values, [&](int i) {
+		return (unsigned int)(descriptor_buffer[ChildIndex(index, descriptor, i)] >> 56);
+	}, child_values);
+
+	descriptor_buffer[index] = coverage_descriptor;
+	lod_buffer[index] = value;
+}
+
+void Octree::EditLevelOfDetail(GeneratedNode* node, GeneratedNode* children, uint8_t* child_values) {
+
+	uint64_t &descriptor = std::get<0>(*node);
+
+	// The child block went in behind any far pointers, in child order
+	uint64_t block_position = std::get<1>(*node);
+	for (int i = 0; i < 8; i++)
+		if ((descriptor >> 16) & ~(descriptor >> 24) & mask_8[i])
+			lod_buffer[block_position++] = child_values[i];
+
+	child_values[8] = CombineLevelOfDetail(&descriptor, std::get<2>(*node), [&](int i) {
+		return (unsigned int)(std::get<0>(children[i]) >> 56);
+	}, child_values);
+}
+
+template <typename ChildCoverage>
+uint8_t Octree::CombineLevelOfDetail(uint64_t* descriptor, uint64_t leaf_values, ChildCoverage child_coverage, const uint8_t* child_values) {
+
+	// Each valid child weighs in with its coverage, a valid leaf is solid
+	uint8_t values[8];
+	unsigned int weights[8];
+	int count = 0;
+	unsigned int total = 0;
+
+	for (int i = 0; i < 8; i++) {
+
+		if (!((*descriptor >> 16) & mask_8[i]))
+			continue;
+
+		if ((*descriptor >> 24) & mask_8[i]) {
+			values[count] = (uint8_t)(leaf_values >> (i * 8));
+			weights[count] = 255;
+		}
+		else {
+			values[count] = child_values[i];
+			weights[count] = child_coverage(i);
+		}
+
+		total += weights[count++];
+	}
+
+	// Rounded, but only a node with nothing in it reads as empty and only a solid one as full
+	uint64_t coverage = (total + 4) / 8;
+	if (total > 0 && coverage == 0)
+		coverage = 1;
+	if (total < 8 * 255 && coverage == 255)
+		coverage = 254;
+
+	uint8_t value = 0;
+	unsigned int best = 0;
+	for (int i = 0; i < count; i++) {
+
+		unsigned int weight = 0;
+		for (int j = 0; j < count; j++)
+			if (values[j] == values[i])
+				weight += weights[j];
+
+		if (weight > best) {
+			best = weight;
+			value = values[i];
+		}
+	}
+
+	*descriptor = (*descriptor & ~contour_mask) | (coverage << 56);
+	return value;
+}
+
+void Octree::UpdateLevelOfDetail(const OctState &path) {
+
+	for (int scale = path.parent_stack_position; scale >= 0; scale--)
+		SetLevelOfDetail(path.parent_stack_index[scale]);
+}
+
+void Octree::Compact() {
+	Rebuild(deduplicated);
+}
+
+void Octree::CompactIfGrown() {
+
+	// Small trees get some slack, compacting them every few edits would cost more than the
+	// garbage
+	const uint64_t minimum_size = 4096;
+
+	if (auto_compact_growth > 0 && descriptor_buffer.size() >= std::max((uint64_t)(compacted_size * auto_compact_growth), minimum_size))
+		Compact();
+}
+
+void Octree::Deduplicate() {
+	Rebuild(true);
+}
+
+void Octree::Rebuild(bool deduplicate) {
+
+	revision++;
+	distance_buffer.clear();
+
+	DescriptorSegment segment;
+	segment.deduplicate = deduplicate;
+
+	std::unordered_map<uint64_t, GeneratedNode> rebuilt;
+
+	GeneratedNode root_node = CompactRecursion(root_index, Descriptor(root_index), &segment, deduplicated ? &rebuilt : nullptr);
+	root_index = WriteChildBlock(&segment, &root_node, 1);
+
+	deduplicated = deduplicate;
+
+	descriptor_buffer = std::move(segment.descriptors);
+	descriptor_buffer.trim();
+	compacted_size = descriptor_buffer.size();
+
+	BuildAttachments(&segment.leaf_values);
+	edit_attachment_buffer.clear();
+
+	page_header_counter = segment.page_header_counter;
+	build_stats = segment.stats;
+
+	page_cache.reset();
+	BuildLevelOfDetail();
+	UnmapFile();
+}
+
+GeneratedNode Octree::CompactRecursion(uint64_t index, uint64_t descriptor, DescriptorSegment* segment, std::unordered_map<uint64_t, GeneratedNode>* rebuilt) {
+
+	if (rebuilt != nullptr) {
+		auto done = rebuilt->find(index);
+		if (done != rebuilt->end())
+			return done->second;
+	}
+
+	GeneratedNode children[8];
+	CopyChildren(index, descriptor, children);
+
+	GeneratedNode node(0, 0, 0);
+	GeneratedNode child_block[8];
+	int child_block_size = 0;
+
+	for (int i = 0; i < 8; i++) {
+
+		// Descend into the children that still have descriptors, collapsing them if edits left
+		// them uniform
+		if ((descriptor >> 16) & ~(descriptor >> 24) & mask_8[i]) {
+			uint64_t child_index = ChildIndex(index, descriptor, i);
+			children[i] = CompactRecursion(child_index, Descriptor(child_index), segment, rebuilt);
+		}
+
+		AttachChild(i, children[i], &node, child_block, &child_block_size);
+	}
+
+	std::get<1>(node) = WriteChildBlock(segment, child_block, child_block_size);
+
+	if (rebuilt != nullptr)
+		(*rebuilt)[index] = node;
+
+	return node;
+}
+
+void Octree::CopyChildren(uint64_t index, uint64_t descriptor, GeneratedNode* children, uint8_t* child_values) {
+
+	uint64_t values = LeafValues(index, descriptor);
+
+	for (int i = 0; i < 8; i++) {
+
+		if (!((descriptor >> 16) & mask_8[i])) {
+			children[i] = GeneratedNode(leaf_mask, 0, 0);
+		}
+		else if ((descriptor >> 24) & mask_8[i]) {
+			children[i] = GeneratedNode(leaf_mask | valid_mask, 0, ((values >> (i * 8)) & 0xFF) * 0x0101010101010101);
+		}
+		else {
+
+			uint64_t child_index = ChildIndex(index, descriptor, i);
+			uint64_t child = Descriptor(child_index);
+
+			// The child keeps its masks, and its edit attachment as it's about to be moved. The
+			// pointers get rewritten once the copy is placed
+			uint64_t copy = child & (valid_mask | leaf_mask | contour_mask);
+			if (child & contour_edit_bit)
+				copy |= child & contour_pointer_mask;
+
+			uint64_t block_position = HasChildBlock(child) ? ChildBlockPosition(child_index, child) : 0;
+
+			children[i] = GeneratedNode(copy, block_position, LeafValues(child_index, child));
+			if (child_values != nullptr)
+				child_values[i] = lod_buffer[child_index];
+		}
+	}
+}
+
+GeneratedNode Octree::EditNode(GeneratedNode* children, DescriptorSegment* segment) {
+
+	GeneratedNode node(0, 0, 0);
+	GeneratedNode child_block[8];
+	int child_block_size = 0;
+
+	for (int i = 0; i < 8; i++)
+		AttachChild(i, children[i], &node, child_block, &child_block_size);
+
+	for (int i = 0; i < child_block_size; i++)
+		AssignEditAttachment(&child_block[i]);
+
+	std::get<1>(node) = WriteChildBlock(segment, child_block, child_block_size);
+
+	return node;
+}
+
+void Octree::AssignEditAttachment(GeneratedNode* node) {
+
+	uint64_t &descriptor = std::get<0>(*node);
+
+	if (descriptor & contour_edit_bit) {
+		edit_attachment_buffer[(descriptor & contour_pointer_mask & ~contour_edit_bit) >> 32] = std::get<2>(*node);
+		return;
+	}
+
+	if (!std::get<2>(*node))
+		return;
+
+	if (edit_attachment_buffer.size() >= (contour_edit_bit >> 32)) {
+		edit_attachments_full = true;
+		return;
+	}
+
+	descriptor = (descriptor & ~contour_pointer_mask) | contour_edit_bit | (edit_attachment_buffer.size() << 32);
+	edit_attachment_buffer.push_back(std::get<2>(*node));
+}
+
+char Octree::get1DIndexedVoxel(char* data, Vector3i dimensions, VoxelLayout layout, Vector3i position) {	
+
+	if (layout == VoxelLayout::Occupancy) {
+		uint64_t bit = ArrayMap::getIndex(layout, dimensions, position);
+		uint64_t word;
+		std::memcpy(&word, data + (bit >> 6) * sizeof(word), sizeof(word));
+		return (char)((word >> (bit & 63)) & 1);
+	}
+
+	return data[ArrayMap::getIndex(layout, dimensions, position)];
+}
+
+uint64_t Octree::GetVoxelBlock(char* data, Vector3i dimensions, VoxelLayout layout, Vector3i pos) {
+
+	uint64_t voxels = 0;
+
+	// In Z-order the block is 8 bytes in a row, already in child idx order
+	if (layout == VoxelLayout::Morton) {
+		std::memcpy(&voxels, data + ArrayMap::getIndex(layout, dimensions, pos), sizeof(voxels));
+		return voxels;
+	}
+
+	// The block is 8 bits in a row of its brick's word, spread out to a byte each
+	if (layout == VoxelLayout::Occupancy) {
+		uint64_t bit = ArrayMap::getIndex(layout, dimensions, pos);
+		std::memcpy(&voxels, data + (bit >> 6) * sizeof(voxels), sizeof(voxels));
+		voxels = (voxels >> (bit & 63)) & 0xFF;
+		voxels = (voxels | voxels << 28) & 0x0000000F0000000F;
+		voxels = (voxels | voxels << 14) & 0x0003000300030003;
+		voxels = (voxels | voxels << 7) & 0x0101010101010101;
+		return voxels;
+	}
+
+	for (int i = 0; i < 8; i++) {
+		Vector3i position(pos.x + (i & 1), pos.y + ((i >> 1) & 1), pos.z + (i >> 2));
+		voxels |= (uint64_t)(uint8_t)get1DIndexedVoxel(data, dimensions, layout, position) << (i * 8);
+	}
+
+	return voxels;
+}
+
+void Octree::Decode(char* data, unsigned int thread_count) {
+	Decode(IntCube(0, 0, 0, oct_dimensions, oct_dimensions, oct_dimensions), data, thread_count);
+}
+
+void Octree::Decode(IntCube region, char* data, unsigned int thread_count) {
+
+	if (thread_count == 0)
+		thread_count = std::max(1u, std::thread::hardware_concurrency());
+
+	std::vector<TreeTask> tasks = SplitTree(region, 8 * thread_count);
+
+	// The tasks cover separate parts of the region so the workers never write to the same voxel
+	std::atomic<size_t> next_task(0);
+
+	auto worker = [&]() {
+		size_t i;
+		while ((i = next_task++) < tasks.size()) {
+			const TreeTask &task = tasks[i];
+			if (task.region)
+				FillRegion(region, data, IntCube(task.pos.x, task.pos.y, task.pos.z, task.size, task.size, task.size), task.value);
+			else
+				DecodeRecursion(region, data, task.index, task.descriptor, task.pos, task.size);
+		}
+	};
+
+	std::vector<std::thread> workers;
+	for (unsigned int i = 1; i < std::min(thread_count, (unsigned int)tasks.size()); i++)
+		workers.emplace_back(worker);
+	worker();
+	for (std::thread &t : workers)
+		t.join();
+}
+
+void Octree::DecodeRecursion(IntCube region, char* data, uint64_t index, uint64_t descriptor, Vector3i pos, unsigned int size) {
+
+	unsigned int child_size = size / 2;
+	uint64_t values = LeafValues(index, descriptor);
+
+	// Leaf level nodes inside the region write their 8 voxels straight out
+	if (size == 2 &&
+		pos.x >= region.left && pos.x + 2 <= region.left + region.width &&
+		pos.y >= region.top && pos.y + 2 <= region.top + region.height &&
+		pos.z >= region.front && pos.z + 2 <= region.front + region.depth) {
+
+		for (int i = 0; i < 8; i++) {
+			uint64_t offset = (pos.x + (i & 1) - region.left) +
+				(uint64_t)region.width * ((pos.y + ((i >> 1) & 1) - region.top) + (uint64_t)region.height * (pos.z + (i >> 2) - region.front));
+			data[offset] = (char)(values >> (i * 8));
+		}
+		return;
+	}
+
+	for (int i = 0; i < 8; i++) {
+
+		IntCube child(
+			pos.x + (i & idx_set_x_mask ? child_size : 0),
+			pos.y + (i & idx_set_y_mask ? child_size : 0),
+			pos.z + (i & idx_set_z_mask ? child_size : 0),
+			child_size, child_size, child_size
+		);
+
+		if (!region.intersects(child))
+			continue;
+
+		if ((descriptor >> 16) & ~(descriptor >> 24) & mask_8[i]) {
+			uint64_t child_index = ChildIndex(index, descriptor, i);
+			DecodeRecursion(region, data, child_index, Descriptor(child_index), Vector3i(child.left, child.top, child.front), child_size);
+		}
+		else {
+			FillRegion(region, data, child, (char)(values >> (i * 8)));
+		}
+	}
+}
+
+void Octree::FillRegion(IntCube region, char* data, IntCube cube, char value) {
+
+	IntCube inside;
+	if (!region.intersects(cube, inside))
+		return;
+
+	// A row at a time, memset turns it into wide stores
+	for (int z = inside.front; z < inside.front + inside.depth; z++) {
+		for (int y = inside.top; y < inside.top + inside.height; y++) {
+			uint64_t offset = (inside.left - region.left) + (uint64_t)region.width * ((y - region.top) + (uint64_t)region.height * (z - region.front));
+			std::memset(data + offset, value, inside.width);
+		}
+	}
+}
+
+Mesh Octree::ExtractMesh(IntCube region, unsigned int thread_count, unsigned int chunk_size) {
+
+	if (thread_count == 0)
+		thread_count = std::max(1u, std::thread::hardware_concurrency());
+
+	int size = std::max(1, (int)chunk_size);
+
+	std::vector<IntCube> chunks;
+	for (int z = region.front; z < region.front + region.depth; z += size)
+		for (int y = region.top; y < region.top + region.height; y += size)
+			for (int x = region.left; x < region.left + region.width; x += size)
+				chunks.push_back(IntCube(x, y, z,
+					std::min(size, region.left + region.width - x),
+					std::min(size, region.top + region.height - y),
+					std::min(size, region.front + region.depth - z)));
+
+	std::vector<Mesh> meshes(chunks.size());
+	std::atomic<size_t> next_chunk(0);
+
+	auto worker = [&]() {
+
+		std::vector<char> data;
+
+		size_t i;
+		while ((i = next_chunk++) < chunks.size()) {
+
+			const IntCube &chunk = chunks[i];
+			if (!AnyOccupied(chunk))
+				continue;
+
+			// The chunk with a voxel of its neighbours all the way around
+			IntCube padded(chunk.left - 1, chunk.top - 1, chunk.front - 1, chunk.width + 2, chunk.height + 2, chunk.depth + 2);
+			uint64_t volume = (uint64_t)padded.width * padded.height * padded.depth;
+			if (CountOccupied(padded) == volume)
+				continue;
+
+			data.assign(volume, 0);
+			Decode(padded, data.data(), 1);
+
+			meshes[i].addVoxels(data.data(), Vector3i(padded.width, padded.height, padded.depth), Vector3i(chunk.left, chunk.top, chunk.front));
+		}
+	};
+
+	std::vector<std::thread> workers;
+	for (unsigned int i = 1; i < std::min(thread_count, (unsigned int)chunks.size()); i++)
+		workers.emplace_back(worker);
+	worker();
+	for (std::thread &t : workers)
+		t.join();
+
+	Mesh mesh;
+	for (const Mesh &chunk_mesh : meshes)
+		mesh.append(chunk_mesh);
+
+	return mesh;
+}
+
+uint64_t Octree::CountOccupied(IntCube region) {
+
+	uint64_t count = 0;
+	auto visit = [&count](IntCube cube, char) {
+		count += (uint64_t)cube.width * cube.height * cube.depth;
+		return true;
+	};
+
+	RegionRecursion(region, root_index, Descriptor(root_index), Vector3i(0, 0, 0), oct_dimensions, visit, 255);
+	return count;
+}
+
+uint64_t Octree::SubtreeOccupied(uint64_t index, Vector3i pos, unsigned int size) {
+
+	uint64_t count = 0;
+	auto visit = [&count](IntCube cube, char) {
+		count += (uint64_t)cube.width * cube.height * cube.depth;
+		return true;
+	};
+
+	RegionRecursion(IntCube(pos.x, pos.y, pos.z, size, size, size), index, Descriptor(index), pos, size, visit, 255);
+	return count;
+}
+
+bool Octree::AnyOccupied(IntCube region) {
+
+	auto visit = [](IntCube, char) {
+		return false;
+	};
+
+	return !RegionRecursion(region, root_index, Descriptor(root_index), Vector3i(0, 0, 0), oct_dimensions, visit, 1);
+}
+
+std::vector<OccupiedRegion> Octree::FindOccupied(IntCube region) {
+
+	std::vector<OccupiedRegion> regions;
+	auto visit = [&regions](IntCube cube, char value) {
+		regions.push_back(OccupiedRegion{ cube, value });
+		return true;
+	};
+
+	RegionRecursion(region, root_index, Descriptor(root_index), Vector3i(0, 0, 0), oct_dimensions, visit);
+	return regions;
+}
+
+std::vector<Vector3i> Octree::FindOccupiedVoxels(IntCube region) {
+
+	std::vector<Vector3i> voxels;
+	auto visit = [&voxels](IntCube cube, char) {
+		for (int z = cube.front; z < cube.front + cube.depth; z++)
+			for (int y = cube.top; y < cube.top + cube.height; y++)
+				for (int x = cube.left; x < cube.left + cube.width; x++)
+					voxels.push_back(Vector3i(x, y, z));
+		return true;
+	};
+
+	RegionRecursion(region, root_index, Descriptor(root_index), Vector3i(0, 0, 0), oct_dimensions, visit);
+	return voxels;
+}
+
+template <typename Visit>
+bool Octree::RegionRecursion(IntCube region, uint64_t index, uint64_t descriptor, Vector3i pos, unsigned int size, Visit &visit, unsigned int whole_coverage) {
+
+	unsigned int child_size = size / 2;
+	uint64_t values = LeafValues(index, descriptor);
+
+	for (int i = 0; i < 8; i++) {
+
+		// Invalid children are empty all the way down
+		if (!((descriptor >> 16) & mask_8[i]))
+			continue;
+
+		IntCube child(
+			pos.x + (i & idx_set_x_mask ? child_size : 0),
+			pos.y + (i & idx_set_y_mask ? child_size : 0),
+			pos.z + (i & idx_set_z_mask ? child_size : 0),
+			child_size, child_size, child_size
+		);
+
+		IntCube inside;
+		if (!region.intersects(child, inside))
+			continue;
+
+		if ((descriptor >> 24) & mask_8[i]) {
+			if (!visit(inside, (char)(values >> (i * 8))))
+				return false;
+		}
+		else {
+
+			uint64_t child_index = ChildIndex(index, descriptor, i);
+			uint64_t child_descriptor = Descriptor(child_index);
+
+			if ((child_descriptor >> 56) >= whole_coverage && region.contains(child)) {
+				if (!visit(child, (char)lod_buffer[child_index]))
+					return false;
+			}
+			else if (!RegionRecursion(region, child_index, child_descriptor, Vector3i(child.left, child.top, child.front), child_size, visit, whole_coverage)) {
+				return false;
+			}
+		}
+	}
+
+	return true;
+}
+
+// One pass of the squared distance transform over lines of length entries, stride apart. Each
+// entry becomes the lowest of the parabolas rooted at the entries of its line, found as their
+// lower envelope in linear time. The lines are split across thread_count threads
+static void DistanceTransformPass(float* distances, uint64_t line_count, uint64_t length, uint64_t stride, unsigned int thread_count) {
+
+	std::atomic<uint64_t> next_line(0);
+	const uint64_t lines_per_task = 64;
+
+	auto worker = [&]() {
+
+		std::vector<float> f(length);
+		std::vector<int> v(length);
+		std::vector<float> z(length + 1);
+
+		uint64_t first;
+		while ((first = next_line.fetch_add(lines_per_task)) < line_count) {
+			for (uint64_t line = first; line < std::min(first + lines_per_task, line_count); line++) {
+
+				// Lines along the first axis are contiguous, the others start stride apart within
+				// their slab and the slabs are stride * length apart
+				float* start = distances + (line % stride) + (line / stride) * stride * length;
+
+				for (uint64_t i = 0; i < length; i++)
+					f[i] = start[i * stride];
+
+				int k = 0;
+				v[0] = 0;
+				z[0] = -std::numeric_limits<float>::infinity();
+				z[1] = std::numeric_limits<float>::infinity();
+
+				for (int q = 1; q < (int)length; q++) {
+
+					float s = ((f[q] + (float)q * q) - (f[v[k]] + (float)v[k] * v[k])) / (2.0f * (q - v[k]));
+					while (s <= z[k]) {
+						k--;
+						s = ((f[q] + (float)q * q) - (f[v[k]] + (float)v[k] * v[k])) / (2.0f * (q - v[k]));
+					}
+
+					k++;
+					v[k] = q;
+					z[k] = s;
+					z[k + 1] = std::numeric_limits<float>::infinity();
+				}
+
+				k = 0;
+				for (int q = 0; q < (int)length; q++) {
+					while (z[k + 1] < q)
+						k++;
+					start[q * stride] = (float)(q - v[k]) * (q - v[k]) + f[v[k]];
+				}
+			}
+		}
+	};
+
+	std::vector<std::thread> workers;
+	for (unsigned int i = 1; i < std::min((uint64_t)thread_count, (line_count + lines_per_task - 1) / lines_per_task); i++)
+		workers.emplace_back(worker);
+	worker();
+	for (std::thread &t : workers)
+		t.join();
+}
+
+void Octree::DistanceField(IntCube region, float* distances, unsigned int thread_count) {
+
+	if (region.width <= 0 || region.height <= 0 || region.depth <= 0)
+		return;
+
+	if (thread_count == 0)
+		thread_count = std::max(1u, std::thread::hardware_concurrency());
+
+	uint64_t width = region.width;
+	uint64_t height = region.height;
+	uint64_t depth = region.depth;
+	uint64_t count = width * height * depth;
+
+	std::vector<char> data(count, 0);
+	Decode(region, data.data(), thread_count);
+
+	// Stands in for infinity in the passes, it has to survive having squared distances added
+	// to it and being subtracted from itself
+	const float far = 1e20f;
+	for (uint64_t i = 0; i < count; i++)
+		distances[i] = data[i] ? 0 : far;
+
+	DistanceTransformPass(distances, height * depth, width, 1, thread_count);
+	DistanceTransformPass(distances, width * depth, height, width, thread_count);
+	DistanceTransformPass(distances, width * height, depth, width * height, thread_count);
+
+	for (uint64_t i = 0; i < count; i++)
+		distances[i] = distances[i] >= far / 2 ? std::numeric_limits<float>::infinity() : std::sqrt(distances[i]);
+}
+
+// Squared distance between the nearest points of two cubes, 0 if they touch
+static float CubeDistanceSquared(const IntCube &a, const IntCube &b) {
+
+	int dx = std::max(0, std::max(b.left - (a.left + a.width), a.left - (b.left + b.width)));
+	int dy = std::max(0, std::max(b.top - (a.top + a.height), a.top - (b.top + b.height)));
+	int dz = std::max(0, std::max(b.front - (a.front + a.depth), a.front - (b.front + b.depth)));
+
+	return (float)dx * dx + (float)dy * dy + (float)dz * dz;
+}
+
+void Octree::BuildDistanceBounds(unsigned int thread_count) {
+
+	if (thread_count == 0)
+		thread_count = std::max(1u, std::thread::hardware_concurrency());
+
+	// Every node in the tree. A DAG's shared nodes come up once for every place they're used
+	// as their bounds depend on where they are
+	std::vector<TreeTask> nodes;
+	nodes.push_back(TreeTask{ root_index, Descriptor(root_index), Vector3i(0, 0, 0), oct_dimensions, false, 0 });
+
+	for (size_t n = 0; n < nodes.size(); n++) {
+
+		TreeTask node = nodes[n];
+		unsigned int child_size = node.size / 2;
+
+		for (int i = 0; i < 8; i++) {
+			if ((node.descriptor >> 16) & ~(node.descriptor >> 24) & mask_8[i]) {
+
+				Vector3i pos(
+					node.pos.x + (i & idx_set_x_mask ? child_size : 0),
+					node.pos.y + (i & idx_set_y_mask ? child_size : 0),
+					node.pos.z + (i & idx_set_z_mask ? child_size : 0)
+				);
+
+				uint64_t child_index = ChildIndex(node.index, node.descriptor, i);
+				nodes.push_back(TreeTask{ child_index, Descriptor(child_index), pos, child_size, false, 0 });
+			}
+		}
+	}
+
+	std::vector<uint64_t> bounds(nodes.size(), 0);
+	std::atomic<size_t> next_node(0);
+	const size_t nodes_per_task = 64;
+
+	uint64_t root_descriptor = Descriptor(root_index);
+
+	auto worker = [&]() {
+		size_t first;
+		while ((first = next_node.fetch_add(nodes_per_task)) < nodes.size()) {
+			for (size_t n = first; n < std::min(first + nodes_per_task, nodes.size()); n++) {
+
+				const TreeTask &node = nodes[n];
+				unsigned int child_size = node.size / 2;
+
+				for (int i = 0; i < 8; i++) {
+
+					if ((node.descriptor >> 16) & mask_8[i])
+						continue;
+
+					IntCube child(
+						node.pos.x + (i & idx_set_x_mask ? child_size : 0),
+						node.pos.y + (i & idx_set_y_mask ? child_size : 0),
+						node.pos.z + (i & idx_set_z_mask ? child_size : 0),
+						child_size, child_size, child_size
+					);
+
+					// Rounded down so the bound stays a lower bound
+					float nearest = NearestOccupied(child, root_index, root_descriptor, Vector3i(0, 0, 0), oct_dimensions, 255.0f * 255.0f);
+					uint64_t bound = std::min(255, (int)std::sqrt(nearest));
+					bounds[n] |= bound << (i * 8);
+				}
+			}
+		}
+	};
+
+	std::vector<std::thread> workers;
+	for (unsigned int i = 1; i < std::min((size_t)thread_count, (nodes.size() + nodes_per_task - 1) / nodes_per_task); i++)
+		workers.emplace_back(worker);
+	worker();
+	for (std::thread &t : workers)
+		t.join();
+
+	// A shared node keeps the lowest bound of everywhere it's used
+	distance_buffer.clear();
+	distance_buffer.resize(descriptor_buffer.size());
+	std::vector<bool> seen(descriptor_buffer.size());
+
+	for (size_t n = 0; n < nodes.size(); n++) {
+
+		uint64_t index = nodes[n].index;
+		if (!seen[index]) {
+			seen[index] = true;
+			distance_buffer[index] = bounds[n];
+			continue;
+		}
+
+		uint64_t merged = 0;
+		for (int i = 0; i < 8; i++) {
+			uint64_t shift = i * 8;
+			merged |= std::min((distance_buffer[index] >> shift) & 0xFF, (bounds[n] >> shift) & 0xFF) << shift;
+		}
+		distance_buffer[index] = merged;
+	}
+}
+
+float Octree::NearestOccupied(const IntCube &cube, uint64_t index, uint64_t descriptor, Vector3i pos, unsigned int size, float best) {
+
+	unsigned int child_size = size / 2;
+
+	// Valid children nearer than the best so far, nearest first
+	int order[8];
+	float distances[8];
+	int count = 0;
+
+	for (int i = 0; i < 8; i++) {
+
+		if (!((descriptor >> 16) & mask_8[i]))
+			continue;
+
+		IntCube child(
+			pos.x + (i & idx_set_x_mask ? child_size : 0),
+			pos.y + (i & idx_set_y_mask ? child_size : 0),
+			pos.z + (i & idx_set_z_mask ? child_size : 0),
+			child_size, child_size, child_size
+		);
+
+		float distance = CubeDistanceSquared(cube, child);
+		if (distance >= best)
+			continue;
+
+		int j = count++;
+		while (j > 0 && distances[j - 1] > distance) {
+			order[j] = order[j - 1];
+			distances[j] = distances[j - 1];
+			j--;
+		}
+		order[j] = i;
+		distances[j] = distance;
+	}
+
+	for (int j = 0; j < count; j++) {
+
+		if (distances[j] >= best)
+			break;
+
+		int i = order[j];
+		if ((descriptor >> 24) & mask_8[i]) {
+			best = distances[j];
+			continue;
+		}
+
+		Vector3i child_pos(
+			pos.x + (i & idx_set_x_mask ? child_size : 0),
+			pos.y + (i & idx_set_y_mask ? child_size : 0),
+			pos.z + (i & idx_set_z_mask ? child_size : 0)
+		);
+
+		uint64_t child_index = ChildIndex(index, descriptor, i);
+		best = NearestOccupied(cube, child_index, Descriptor(child_index), child_pos, child_size, best);
+	}
+
+	return best;
+}
+
+uint8_t Octree::DistanceBound(uint64_t index, int idx) {
+
+	if (index >= distance_buffer.size())
+		return 0;
+
+	return (uint8_t)(distance_buffer[index] >> (idx * 8));
+}
+
+float Octree::Clearance(Vector3i position) {
+
+	if (position.x < 0 || position.y < 0 || position.z < 0 ||
+		position.x >= (int)oct_dimensions || position.y >= (int)oct_dimensions || position.z >= (int)oct_dimensions)
+		return 0;
+
+	OctState state = GetVoxel(position);
+	if (state.value != 0)
+		return 0;
+
+	// The lookup stopped at the empty child of the node at its scale
+	return DistanceBound(state.parent_stack_index[state.scale], state.idx_stack[state.scale]);
+}
+
+// Union find over the labelled cubes, with path halving. Sets are joined under their lowest
+// cube so the roots come out the same whatever order the joins happen in
+static uint32_t ComponentRoot(std::vector<uint32_t>* parents, uint32_t i) {
+
+	std::vector<uint32_t> &parent = *parents;
+	while (parent[i] != i) {
+		parent[i] = parent[parent[i]];
+		i = parent[i];
+	}
+	return i;
+}
+
+static void ComponentJoin(std::vector<uint32_t>* parents, uint32_t a, uint32_t b) {
+
+	a = ComponentRoot(parents, a);
+	b = ComponentRoot(parents, b);
+
+	if (a < b)
+		(*parents)[b] = a;
+	else if (b < a)
+		(*parents)[a] = b;
+}
+
+ComponentLabels Octree::ConnectedComponents(bool empty, unsigned int thread_count) {
+
+	if (thread_count == 0)
+		thread_count = std::max(1u, std::thread::hardware_concurrency());
+
+	ComponentLabels result;
+
+	std::vector<ComponentCell> cells;
+	cells.push_back(ComponentCell{ 0, no_cube });
+	ComponentCellBuild(empty, root_index, Descriptor(root_index), Vector3i(0, 0, 0), oct_dimensions, 0, &cells, &result.cubes);
+
+	// Each subtree a couple of levels down numbers its cubes in a run of its own, so the
+	// threads joining inside them never touch the same part of the union find
+	std::vector<uint32_t> parents(result.cubes.size());
+	for (uint32_t i = 0; i < (uint32_t)parents.size(); i++)
+		parents[i] = i;
+
+	unsigned int split_depth = thread_count > 1 ? 2 : 0;
+
+	std::vector<uint32_t> subtrees;
+	std::vector<uint32_t> level = { 0 };
+	for (unsigned int depth = 0; depth < split_depth; depth++) {
+
+		std::vector<uint32_t> next;
+		for (uint32_t cell : level)
+			if (cells[cell].first_child != 0)
+				for (uint32_t i = 0; i < 8; i++)
+					next.push_back(cells[cell].first_child + i);
+		level.swap(next);
+	}
+	for (uint32_t cell : level)
+		if (cells[cell].first_child != 0)
+			subtrees.push_back(cell);
+
+	std::atomic<size_t> next_subtree(0);
+
+	auto worker = [&]() {
+		size_t i;
+		while ((i = next_subtree++) < subtrees.size())
+			ComponentCellRecursion(cells, &parents, subtrees[i], split_depth, 32);
+	};
+
+	std::vector<std::thread> workers;
+	for (unsigned int i = 1; i < std::min(thread_count, (unsigned int)subtrees.size()); i++)
+		workers.emplace_back(worker);
+	worker();
+	for (std::thread &t : workers)
+		t.join();
+
+	// Then the faces above the subtrees, which cross between them
+	if (split_depth > 0)
+		ComponentCellRecursion(cells, &parents, 0, 0, split_depth);
+
+	result.labels.resize(result.cubes.size());
+	std::vector<uint32_t> component_of(result.cubes.size(), no_cube);
+
+	for (uint32_t i = 0; i < (uint32_t)result.cubes.size(); i++) {
+
+		uint32_t root = ComponentRoot(&parents, i);
+		if (component_of[root] == no_cube) {
+			component_of[root] = (uint32_t)result.components.size();
+			result.components.push_back(ConnectedComponent{ result.cubes[i], 0 });
+		}
+
+		uint32_t label = component_of[root];
+		result.labels[i] = label;
+
+		const IntCube &cube = result.cubes[i];
+		ConnectedComponent &component = result.components[label];
+
+		int right = std::max(component.bounds.left + component.bounds.width, cube.left + cube.width);
+		int bottom = std::max(component.bounds.top + component.bounds.height, cube.top + cube.height);
+		int back = std::max(component.bounds.front + component.bounds.depth, cube.front + cube.depth);
+
+		component.bounds.left = std::min(component.bounds.left, cube.left);
+		component.bounds.top = std::min(component.bounds.top, cube.top);
+		component.bounds.front = std::min(component.bounds.front, cube.front);
+		component.bounds.width = right - component.bounds.left;
+		component.bounds.height = bottom - component.bounds.top;
+		component.bounds.depth = back - component.bounds.front;
+
+		component.voxels += (uint64_t)cube.width * cube.height * cube.depth;
+	}
+
+	return result;
+}
+
+void Octree::ComponentCellBuild(bool empty, uint64_t index, uint64_t descriptor, Vector3i pos, unsigned int size, uint32_t cell, std::vector<ComponentCell>* cells, std::vector<IntCube>* cubes) {
+
+	unsigned int child_size = size / 2;
+	uint32_t first_child = (uint32_t)cells->size();
+
+	(*cells)[cell].first_child = first_child;
+	cells->resize(cells->size() + 8, ComponentCell{ 0, no_cube });
+
+	for (int i = 0; i < 8; i++) {
+
+		Vector3i child_pos(
+			pos.x + (i & idx_set_x_mask ? child_size : 0),
+			pos.y + (i & idx_set_y_mask ? child_size : 0),
+			pos.z + (i & idx_set_z_mask ? child_size : 0)
+		);
+
+		bool valid = ((descriptor >> 16) & mask_8[i]) != 0;
+		bool leaf = ((descriptor >> 24) & mask_8[i]) != 0;
+
+		if (valid && !leaf) {
+			uint64_t child_index = ChildIndex(index, descriptor, i);
+			ComponentCellBuild(empty, child_index, Descriptor(child_index), child_pos, child_size, first_child + i, cells, cubes);
+		}
+		else if (valid != empty) {
+			(*cells)[first_child + i].cube = (uint32_t)cubes->size();
+			cubes->push_back(IntCube(child_pos.x, child_pos.y, child_pos.z, child_size, child_size, child_size));
+		}
+	}
+}
+
+void Octree::ComponentCellRecursion(const std::vector<ComponentCell> &cells, std::vector<uint32_t>* parents, uint32_t cell, unsigned int depth, unsigned int stop_depth) {
+
+	uint32_t first_child = cells[cell].first_child;
+	if (first_child == 0)
+		return;
+
+	if (depth + 1 < stop_depth)
+		for (uint32_t i = 0; i < 8; i++)
+			ComponentCellRecursion(cells, parents, first_child + i, depth + 1, stop_depth);
+
+	// The 12 faces between the children, 4 across each axis
+	for (int axis = 0; axis < 3; axis++)
+		for (uint32_t i = 0; i < 8; i++)
+			if (!(i & (1 << axis)))
+				ComponentFaceRecursion(cells, parents, first_child + i, first_child + (i | (1 << axis)), axis);
+}
+
+void Octree::ComponentFaceRecursion(const std::vector<ComponentCell> &cells, std::vector<uint32_t>* parents, uint32_t low, uint32_t high, int axis) {
+
+	const ComponentCell &low_cell = cells[low];
+	const ComponentCell &high_cell = cells[high];
+
+	bool low_uniform = low_cell.first_child == 0;
+	bool high_uniform = high_cell.first_child == 0;
+
+	// A uniform cell that isn't being labelled cuts the face off
+	if ((low_uniform && low_cell.cube == no_cube) || (high_uniform && high_cell.cube == no_cube))
+		return;
+
+	if (low_uniform && high_uniform) {
+		ComponentJoin(parents, low_cell.cube, high_cell.cube);
+		return;
+	}
+
+	// Down to the 4 children on each side that touch the face, a uniform side faces all 4 of
+	// the other sides children
+	uint32_t bit = 1 << axis;
+	for (uint32_t i = 0; i < 8; i++) {
+		if (i & bit)
+			continue;
+
+		uint32_t low_child = low_uniform ? low : low_cell.first_child + (i | bit);
+		uint32_t high_child = high_uniform ? high : high_cell.first_child + i;
+		ComponentFaceRecursion(cells, parents, low_child, high_child, axis);
+	}
+}
+
+std::vector<Octree::TreeTask> Octree::SplitTree(IntCube region, unsigned int task_count) {
+
+	// Break the top of the tree up into at least task_count pieces, a piece is either a subtree
+	// or a leaf region. Anything outside of the region is left out
+	std::vector<TreeTask> tasks;
+	tasks.push_back(TreeTask{ root_index, Descriptor(root_index), Vector3i(0, 0, 0), oct_dimensions, false, 0 });
+
+	size_t first_subtree = 0;
+	while (tasks.size() - first_subtree < task_count) {
+
+		// Expand the next subtree, leaving its leafs in place and adding its children
+		while (first_subtree < tasks.size() && tasks[first_subtree].region)
+			first_subtree++;
+		if (first_subtree == tasks.size() || tasks[first_subtree].size <= 2)
+			break;
+
+		TreeTask task = tasks[first_subtree];
+		tasks.erase(tasks.begin() + first_subtree);
+
+		unsigned int child_size = task.size / 2;
+		for (int i = 0; i < 8; i++) {
+
+			Vector3i pos(
+				task.pos.x + (i & idx_set_x_mask ? child_size : 0),
+				task.pos.y + (i & idx_set_y_mask ? child_size : 0),
+				task.pos.z + (i & idx_set_z_mask ? child_size : 0)
+			);
+
+			if (!region.intersects(IntCube(pos.x, pos.y, pos.z, child_size, child_size, child_size)))
+				continue;
+
+			if ((task.descriptor >> 16) & ~(task.descriptor >> 24) & mask_8[i]) {
+				uint64_t child_index = ChildIndex(task.index, task.descriptor, i);
+				tasks.push_back(TreeTask{ child_index, Descriptor(child_index), pos, child_size, false, 0 });
+			}
+			else {
+				char value = (task.descriptor >> 16) & mask_8[i] ? LeafValue(task.index, task.descriptor, i) : 0;
+				tasks.push_back(TreeTask{ 0, 0, pos, child_size, true, value });
+			}
+		}
+	}
+
+	return tasks;
+}
+
+ValidationReport Octree::Validate(ArrayMap* array_map, unsigned int thread_count, size_t max_reported) {
+	return Validate(array_map->getDataPtr(), array_map->getDimensions(), thread_count, max_reported, array_map->getLayout());
+}
+
+ValidationReport Octree::Validate(char* data, Vector3i dimensions, unsigned int thread_count, size_t max_reported, VoxelLayout layout) {
+
+	if (thread_count == 0)
+		thread_count = std::max(1u, std::thread::hardware_concurrency());
+
+	std::vector<TreeTask> tasks = SplitTree(IntCube(0, 0, 0, dimensions.x, dimensions.y, dimensions.z), 8 * thread_count);
+
+	// Each worker pulls the next task and reports into a report of its own
+	std::vector<ValidationReport> reports(tasks.size());
+	std::atomic<size_t> next_task(0);
+
+	auto worker = [&]() {
+		size_t i;
+		while ((i = next_task++) < tasks.size()) {
+			const TreeTask &task = tasks[i];
+			if (task.region)
+				ValidateRegion(data, dimensions, layout, task.pos, task.size, task.value, max_reported, &reports[i]);
+			else
+				ValidationRecursion(data, dimensions, layout, task.index, task.descriptor, task.pos, task.size, max_reported, &reports[i]);
+		}
+	};
+
+	std::vector<std::thread> workers;
+	for (unsigned int i = 1; i < std::min(thread_count, (unsigned int)tasks.size()); i++)
+		workers.emplace_back(worker);
+	worker();
+	for (std::thread &t : workers)
+		t.join();
+
+	// Merged in task order so the same tree always reports the same positions
+	ValidationReport report;
+	for (ValidationReport &task_report : reports) {
+
+		report.voxels += task_report.voxels;
+		report.mismatch_count += task_report.mismatch_count;
+
+		for (size_t i = 0; i < task_report.mismatches.size() && report.mismatches.size() < max_reported; i++)
+			report.mismatches.push_back(task_report.mismatches[i]);
+	}
+
+	return report;
+}
+
+void Octree::ValidationRecursion(char* data, Vector3i dimensions, VoxelLayout layout, uint64_t index, uint64_t descriptor, Vector3i pos, unsigned int size, size_t max_reported, ValidationReport* report) {
+
+	unsigned int child_size = size / 2;
+
+	// Decoding all the leaf values at once is cheaper than one at a time
+	uint64_t values = LeafValues(index, descriptor);
+
+	// Leaf level nodes compare their 8 voxels straight off
+	if (size == 2 && pos.x + 1 < dimensions.x && pos.y + 1 < dimensions.y && pos.z + 1 < dimensions.z) {
+
+		uint64_t voxels = GetVoxelBlock(data, dimensions, layout, pos);
+
+		// Anything that doesn't match is gone over again below to find which voxels
+		if (voxels == values) {
+			report->voxels += 8;
+			return;
+		}
+	}
+
+	for (int i = 0; i < 8; i++) {
+
+		Vector3i child_pos(
+			pos.x + (i & idx_set_x_mask ? child_size : 0),
+			pos.y + (i & idx_set_y_mask ? child_size : 0),
+			pos.z + (i & idx_set_z_mask ? child_size : 0)
+		);
+
+		if ((descriptor >> 16) & ~(descriptor >> 24) & mask_8[i]) {
+			uint64_t child_index = ChildIndex(index, descriptor, i);
+			ValidationRecursion(data, dimensions, layout, child_index, Descriptor(child_index), child_pos, child_size, max_reported, report);
+		}
+		else {
+			ValidateRegion(data, dimensions, layout, child_pos, child_size, (char)(values >> (i * 8)), max_reported, report);
+		}
+	}
+}
+
+void Octree::ValidateRegion(char* data, Vector3i dimensions, VoxelLayout layout, Vector3i pos, unsigned int size, char value, size_t max_reported, ValidationReport* report) {
+
+	// Only the part of the region that's inside the data can be checked
+	int end_x = std::min(pos.x + (int)size, dimensions.x);
+	int end_y = std::min(pos.y + (int)size, dimensions.y);
+	int end_z = std::min(pos.z + (int)size, dimensions.z);
+
+	// In Z-order a whole node is one run of bytes, only go voxel by voxel if something's off
+	if (layout == VoxelLayout::Morton && end_x - pos.x == (int)size && end_y - pos.y == (int)size && end_z - pos.z == (int)size) {
+
+		const char* run = data + ArrayMap::getIndex(layout, dimensions, pos);
+		uint64_t run_size = (uint64_t)size * size * size;
+
+		if (std::all_of(run, run + run_size, [value](char voxel) { return voxel == value; })) {
+			report->voxels += run_size;
+			return;
+		}
+	}
+
+	// Bricks the node covers whole are checked a word at a time
+	if (layout == VoxelLayout::Occupancy && size >= 4 && (value == 0 || value == 1) &&
+		end_x - pos.x == (int)size && end_y - pos.y == (int)size && end_z - pos.z == (int)size) {
+
+		uint64_t expected = value ? ~(uint64_t)0 : 0;
+		bool uniform = true;
+
+		for (int z = pos.z; z < end_z && uniform; z += 4) {
+			for (int y = pos.y; y < end_y && uniform; y += 4) {
+
+				// The bricks along x are next to each other
+				uint64_t first = ArrayMap::getIndex(layout, dimensions, Vector3i(pos.x, y, z)) >> 6;
+				for (uint64_t brick = first; brick < first + size / 4 && uniform; brick++) {
+					uint64_t word;
+					std::memcpy(&word, data + brick * sizeof(word), sizeof(word));
+					uniform = word == expected;
+				}
+			}
+		}
+
+		if (uniform) {
+			report->voxels += (uint64_t)size * size * size;
+			return;
+		}
+	}
+
+	for (int z = pos.z; z < end_z; z++) {
+		for (int y = pos.y; y < end_y; y++) {
+
+			const char* row = layout == VoxelLayout::Linear ? data + ArrayMap::getIndex(layout, dimensions, Vector3i(0, y, z)) : nullptr;
+
+			for (int x = pos.x; x < end_x; x++) {
+
+				char voxel = layout == VoxelLayout::Linear ? row[x] : get1DIndexedVoxel(data, dimensions, layout, Vector3i(x, y, z));
+				if (voxel == value)
+					continue;
+
+				report->mismatch_count++;
+				if (report->mismatches.size() < max_reported)
+					report->mismatches.push_back(VoxelMismatch{ Vector3i(x, y, z), voxel, value });
+			}
+		}
+	}
+
+	if (end_x > pos.x && end_y > pos.y && end_z > pos.z)
+		report->voxels += (uint64_t)(end_x - pos.x) * (end_y - pos.y) * (end_z - pos.z);
 }
 
 unsigned int Octree::getDimensions() {
@@ -363,3 +2866,23 @@ const uint8_t Octree::count_mask_8[8] = {
 	0x1,  0x3,  0x7,  0xF,
 	0x1F, 0x3F, 0x7F, 0xFF
 };
+
+// Out of class definitions so the constants can be bound to references, std::min and
+// GeneratedNode's constructor take them that way
+const int Octree::page_size;
+const uint32_t Octree::file_version;
+const uint64_t Octree::file_alignment;
+
+const uint8_t Octree::idx_set_x_mask;
+const uint8_t Octree::idx_set_y_mask;
+const uint8_t Octree::idx_set_z_mask;
+
+const uint64_t Octree::child_pointer_mask;
+const uint64_t Octree::far_bit_mask;
+const uint64_t Octree::valid_mask;
+const uint64_t Octree::leaf_mask;
+const uint64_t Octree::contour_pointer_mask;
+const uint64_t Octree::contour_mask;
+const uint64_t Octree::contour_edit_bit;
+
+const uint32_t Octree::no_cube;
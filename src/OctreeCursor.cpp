@@ -0,0 +1,83 @@
+#include "OctreeCursor.h"
+
+OctreeCursor::OctreeCursor(Octree* octree, Vector3i position, unsigned int max_depth) :
+	octree(octree), max_depth(max_depth) {
+
+	MoveTo(position);
+}
+
+char OctreeCursor::MoveTo(Vector3i new_position) {
+
+	position = new_position;
+
+	int dimension = (int)octree->oct_dimensions;
+	if (position.x < 0 || position.y < 0 || position.z < 0 ||
+		position.x >= dimension || position.y >= dimension || position.z >= dimension) {
+
+		// Out here is always empty. The path to the last position inside is left alone for
+		// coming back in
+		outside = true;
+		return 0;
+	}
+
+	outside = false;
+
+	if (!valid || revision != octree->revision) {
+		Restart();
+		return state.value;
+	}
+
+	// The highest bit that differs between the positions is the level their paths through the
+	// tree split at, everything above that is shared. Same as the batched GetVoxels
+	uint32_t difference = (traversed.x ^ position.x) | (traversed.y ^ position.y) | (traversed.z ^ position.z);
+	if (difference == 0)
+		return state.value;
+
+	unsigned int split_scale = levels - 1 - HighestBit(difference);
+
+	// The last lookup stopped above the split, so the new position is under the same node
+	if (split_scale > state.scale) {
+		traversed = position;
+		return state.value;
+	}
+
+	state.scale = split_scale;
+	state.parent_stack_position = split_scale;
+	octree->Traverse(&state, position, max_depth);
+	traversed = position;
+
+	return state.value;
+}
+
+char OctreeCursor::Move(Vector3i offset) {
+	return MoveTo(Vector3i(position.x + offset.x, position.y + offset.y, position.z + offset.z));
+}
+
+char OctreeCursor::Value() const {
+	return outside ? 0 : state.value;
+}
+
+Vector3i OctreeCursor::Position() const {
+	return position;
+}
+
+const OctState& OctreeCursor::State() const {
+	return state;
+}
+
+void OctreeCursor::Restart() {
+
+	levels = 0;
+	while ((1u << levels) < octree->oct_dimensions)
+		levels++;
+
+	state = OctState();
+	state.parent_stack[0] = octree->Descriptor(octree->root_index);
+	state.parent_stack_index[0] = octree->root_index;
+
+	octree->Traverse(&state, position, max_depth);
+	traversed = position;
+
+	revision = octree->revision;
+	valid = true;
+}
@@ -0,0 +1,142 @@
+#include <algorithm>
+#include "PageCache.h"
+
+PageCache::PageCache(std::string file_name, uint64_t offset, uint64_t count, uint64_t capacity) :
+	offset(offset), count(count), max_pages(std::max(capacity, (uint64_t)1)) {
+
+	uint64_t page_count = (count + page_size - 1) / page_size;
+
+	// Each shard gets at least min_shard_pages of the capacity, a shard with only a page or two
+	// to evict from misses far more than one LRU over the whole cache would
+	uint64_t shard_count = std::max(std::min(max_shards, std::min(max_pages, page_count) / min_shard_pages), (uint64_t)1);
+
+	for (uint64_t i = 0; i < shard_count; i++) {
+
+		std::unique_ptr<Shard> shard(new Shard());
+		shard->file.open(file_name, std::ios::binary);
+		shard->max_pages = max_pages / shard_count + (i < max_pages % shard_count ? 1 : 0);
+
+		uint64_t shard_pages = page_count / shard_count + (i < page_count % shard_count ? 1 : 0);
+		shard->page_slot.resize(shard_pages, -1);
+		shard->lru_position.resize(shard_pages);
+
+		shards.push_back(std::move(shard));
+	}
+}
+
+PageCache::~PageCache() {
+	for (std::unique_ptr<Shard> &shard : shards)
+		for (uint64_t* slot : shard->slots)
+			delete[] slot;
+}
+
+bool PageCache::is_open() const {
+	for (const std::unique_ptr<Shard> &shard : shards)
+		if (!shard->file.is_open())
+			return false;
+	return true;
+}
+
+uint64_t PageCache::read(uint64_t index) {
+
+	uint64_t page = index / page_size;
+	Shard* shard = shards[page % shards.size()].get();
+
+	std::lock_guard<std::mutex> lock(shard->mutex);
+
+	if (page == shard->last_page) {
+		shard->counters.hits++;
+		return shard->last_data[index % page_size];
+	}
+
+	shard->last_page = page;
+	shard->last_data = fault(shard, page);
+
+	return shard->last_data[index % page_size];
+}
+
+uint64_t* PageCache::fault(Shard* shard, uint64_t page) {
+
+	uint64_t shard_page = page / shards.size();
+	int64_t slot = shard->page_slot[shard_page];
+
+	if (slot >= 0) {
+
+		// Move it up to the front of the LRU list
+		shard->counters.hits++;
+		shard->lru.splice(shard->lru.begin(), shard->lru, shard->lru_position[shard_page]);
+		return shard->slots[slot];
+	}
+
+	shard->counters.misses++;
+
+	if (shard->slots.size() < shard->max_pages) {
+
+		// Still filling up, give it a fresh slot
+		slot = shard->slots.size();
+		shard->slots.push_back(new uint64_t[page_size]());
+	}
+	else {
+
+		// Take the slot of the page that hasn't been used for the longest
+		uint64_t evicted = shard->lru.back();
+		shard->lru.pop_back();
+
+		slot = shard->page_slot[evicted];
+		shard->page_slot[evicted] = -1;
+		shard->counters.evictions++;
+	}
+
+	shard->page_slot[shard_page] = slot;
+	shard->lru.push_front(shard_page);
+	shard->lru_position[shard_page] = shard->lru.begin();
+
+	// The file holds whole pages, so a full page can always be read
+	shard->file.clear();
+	shard->file.seekg(offset + page * page_size * sizeof(uint64_t));
+	shard->file.read((char*)shard->slots[slot], page_size * sizeof(uint64_t));
+
+	return shard->slots[slot];
+}
+
+uint64_t PageCache::size() const {
+	return count;
+}
+
+uint64_t PageCache::capacity() const {
+	return max_pages;
+}
+
+PageCacheStats PageCache::stats() {
+
+	PageCacheStats total;
+	for (std::unique_ptr<Shard> &shard : shards) {
+		std::lock_guard<std::mutex> lock(shard->mutex);
+		total.hits += shard->counters.hits;
+		total.misses += shard->counters.misses;
+		total.evictions += shard->counters.evictions;
+	}
+
+	return total;
+}
+
+void PageCache::reset_stats() {
+	for (std::unique_ptr<Shard> &shard : shards) {
+		std::lock_guard<std::mutex> lock(shard->mutex);
+		shard->counters = PageCacheStats();
+	}
+}
+
+uint64_t PageCache::memory_usage() {
+
+	uint64_t slot_count = 0;
+	for (std::unique_ptr<Shard> &shard : shards) {
+		std::lock_guard<std::mutex> lock(shard->mutex);
+		slot_count += shard->slots.size();
+	}
+
+	return slot_count * page_size * sizeof(uint64_t);
+}
+
+// Out of class definition, std::min takes it by reference
+const uint64_t PageCache::max_shards;
@@ -0,0 +1,129 @@
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <thread>
+#include "Renderer.h"
+
+Renderer::Renderer(Octree* octree, int width, int height) : octree(octree), width(width), height(height) {
+
+	pixels.resize(width * height * 3);
+
+	float center = octree->getDimensions() / 2.0f;
+	SetCamera(Vector3f(-center, center * 3, -center), Vector3f(center, center, center), 60);
+}
+
+void Renderer::SetCamera(Vector3f position, Vector3f target, float fov_degrees) {
+
+	auto normalize = [](Vector3f v) {
+		float length = std::sqrt(v.x * v.x + v.y * v.y + v.z * v.z);
+		return Vector3f(v.x / length, v.y / length, v.z / length);
+	};
+	auto cross = [](Vector3f a, Vector3f b) {
+		return Vector3f(a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x);
+	};
+
+	camera_position = position;
+	camera_forward = normalize(target - position);
+	camera_right = normalize(cross(camera_forward, Vector3f(0, 1, 0)));
+	camera_up = cross(camera_right, camera_forward);
+
+	fov_scale = std::tan(fov_degrees * 3.14159265f / 360.0f);
+}
+
+FrameStats Renderer::RenderFrame(unsigned int thread_count) {
+
+	if (thread_count == 0)
+		thread_count = std::max(1u, std::thread::hardware_concurrency());
+
+	int tiles_x = (width + tile_size - 1) / tile_size;
+	int tiles_y = (height + tile_size - 1) / tile_size;
+	int tile_count = tiles_x * tiles_y;
+
+	FrameStats stats;
+	stats.tile_seconds.resize(tile_count);
+
+	auto now = []() {
+		return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	};
+
+	double frame_start = now();
+
+	// Each worker pulls the next tile until there are none left
+	std::atomic<int> next_tile(0);
+	auto worker = [&]() {
+		int i;
+		while ((i = next_tile++) < tile_count) {
+			double tile_start = now();
+			RenderTile(i % tiles_x, i / tiles_x);
+			stats.tile_seconds[i] = now() - tile_start;
+		}
+	};
+
+	std::vector<std::thread> workers;
+	for (unsigned int i = 1; i < thread_count; i++)
+		workers.emplace_back(worker);
+	worker();
+	for (std::thread &t : workers)
+		t.join();
+
+	stats.seconds = now() - frame_start;
+	stats.rays_per_second = width * height / stats.seconds;
+
+	return stats;
+}
+
+void Renderer::RenderTile(int tile_x, int tile_y) {
+
+	float max_distance = octree->getDimensions() * 4.0f;
+	float aspect = (float)width / height;
+
+	// Light comes from up and over the shoulder of the default camera
+	const float light[3] = { 0.37f, 0.83f, 0.42f };
+
+	// Colors for the materials, anything past the table is drawn magenta
+	const uint8_t materials[4][3] = { { 255, 0, 255 }, { 128, 128, 128 }, { 130, 90, 50 }, { 120, 200, 90 } };
+
+	for (int y = tile_y * tile_size; y < std::min((tile_y + 1) * tile_size, height); y++) {
+		for (int x = tile_x * tile_size; x < std::min((tile_x + 1) * tile_size, width); x++) {
+
+			float u = ((x + 0.5f) / width * 2 - 1) * fov_scale * aspect;
+			float v = (1 - (y + 0.5f) / height * 2) * fov_scale;
+
+			Vector3f direction = camera_forward + camera_right * u + camera_up * v;
+			RayHit hit = octree->CastRay(camera_position, direction, max_distance);
+
+			uint8_t* pixel = &pixels[(y * width + x) * 3];
+
+			if (!hit.hit) {
+				pixel[0] = 140;
+				pixel[1] = 180;
+				pixel[2] = 225;
+				continue;
+			}
+
+			// Lambert on the face normal with a little ambient, fading out with distance
+			float lambert = hit.normal.x * light[0] + hit.normal.y * light[1] + hit.normal.z * light[2];
+			float shade = 0.25f + 0.75f * std::max(lambert, 0.0f);
+			float fog = std::min(hit.distance / max_distance, 1.0f);
+
+			const uint8_t* color = materials[(uint8_t)hit.value < 4 ? hit.value : 0];
+
+			pixel[0] = (uint8_t)((shade * color[0] * (1 - fog) + 140 * fog));
+			pixel[1] = (uint8_t)((shade * color[1] * (1 - fog) + 180 * fog));
+			pixel[2] = (uint8_t)((shade * color[2] * (1 - fog) + 225 * fog));
+		}
+	}
+}
+
+bool Renderer::WritePPM(std::string file_name) {
+
+	std::ofstream file(file_name, std::ios::binary);
+	if (!file.is_open())
+		return false;
+
+	file << "P6\n" << width << " " << height << "\n255\n";
+	file.write((const char*)pixels.data(), pixels.size());
+
+	return file.good();
+}
@@ -0,0 +1,82 @@
+
+/**
+ * Headless renderer, casts one primary ray per pixel through an octree on worker threads
+ * and writes each frame out as a PPM along with its timings
+ *
+ * OctalotRender [dimension] [width] [height] [frames] [threads] [output prefix]
+ */
+
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include "ArrayMap.h"
+#include "Logger.h"
+#include "Octree.h"
+#include "Renderer.h"
+
+// Tile times bucketed by powers of two microseconds
+void PrintTileHistogram(const std::vector<double>& tile_seconds) {
+
+	std::vector<int> buckets;
+	for (double seconds : tile_seconds) {
+		int bucket = std::max(0, (int)std::log2(seconds * 1e6));
+		if (bucket >= (int)buckets.size())
+			buckets.resize(bucket + 1);
+		buckets[bucket]++;
+	}
+
+	int largest = 1;
+	for (int count : buckets)
+		largest = std::max(largest, count);
+
+	for (int i = 0; i < (int)buckets.size(); i++) {
+		std::stringstream range;
+		range << (1 << i) << "-" << (1 << (i + 1)) << "us";
+		std::cout << "    " << std::setw(16) << range.str() << std::setw(8) << buckets[i] << " "
+			<< std::string(buckets[i] * 50 / largest, '#') << std::endl;
+	}
+}
+
+int main(int argc, char* argv[]) {
+
+	unsigned int dimension = argc > 1 ? std::stoi(argv[1]) : 256;
+	int width = argc > 2 ? std::stoi(argv[2]) : 640;
+	int height = argc > 3 ? std::stoi(argv[3]) : 480;
+	int frames = argc > 4 ? std::stoi(argv[4]) : 1;
+	unsigned int threads = argc > 5 ? std::stoi(argv[5]) : 0;
+	std::string output_prefix = argc > 6 ? argv[6] : "frame";
+
+	Vector3i dim3(dimension, dimension, dimension);
+	ArrayMap array_map(dim3);
+	array_map.fillTerrain();
+
+	Logger::log("Generating Octree", Logger::LogLevel::INFO);
+	Octree octree;
+	octree.Generate(array_map.getDataPtr(), dim3);
+
+	Renderer renderer(&octree, width, height);
+
+	for (int frame = 0; frame < frames; frame++) {
+
+		// Orbit the camera around the middle of the map, one full turn over all the frames
+		float center = dimension / 2.0f;
+		float angle = frame * 2 * 3.14159265f / frames;
+		Vector3f position(center - std::cos(angle) * dimension * 1.2f, dimension * 1.1f, center - std::sin(angle) * dimension * 1.2f);
+		renderer.SetCamera(position, Vector3f(center, center * 0.6f, center), 60);
+
+		FrameStats stats = renderer.RenderFrame(threads);
+
+		std::stringstream file_name;
+		file_name << output_prefix << "_" << std::setw(4) << std::setfill('0') << frame << ".ppm";
+		if (!renderer.WritePPM(file_name.str()))
+			Logger::log("Could not write " + file_name.str(), Logger::LogLevel::ERROR, __LINE__, __FILE__);
+
+		std::cout << "frame " << frame << ": " << std::fixed << std::setprecision(2) << stats.seconds * 1000 << " ms, "
+			<< std::setprecision(0) << stats.rays_per_second << " rays/s, " << stats.tile_seconds.size() << " tiles" << std::endl;
+		PrintTileHistogram(stats.tile_seconds);
+	}
+
+	return 0;
+}